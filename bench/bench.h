@@ -0,0 +1,51 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ContentionResult {
+    long long ops;
+    double seconds;
+    
+    double opsPerSecond() const { return seconds > 0 ? ops / seconds : 0.0; }
+};
+
+// Runs op() in a tight loop on `workers` threads (or forked processes) for
+// durationMs and returns the total number of completed operations.
+ContentionResult runContention(int workers, bool useProcesses, int durationMs,
+                               const std::function<void()>& op);
+
+// Worker counts used by the scaling benchmarks: 1, 2, 4, ... 64
+std::vector<int> defaultWorkerCounts();
+
+// Machine-readable results. Benchmarks record one entry per table row;
+// with --json=PATH the run ends by writing them all as one JSON document,
+// so two runs can be diffed.
+typedef std::vector<std::pair<std::string, std::string>> BenchParams;
+typedef std::vector<std::pair<std::string, double>> BenchMetrics;
+void recordResult(const std::string& name, const BenchParams& params, const BenchMetrics& metrics);
+bool writeResultsJson(const std::string& path, const std::string& benchmark,
+                      int argc, char* argv[]);
+
+int runCounterBench(int argc, char* argv[]);
+int runCounterRmwBench(int argc, char* argv[]);
+int runCounterWaitBench(int argc, char* argv[]);
+int runCounterRegistryBench(int argc, char* argv[]);
+int runCheckpointBench(int argc, char* argv[]);
+int runLoggerBench(int argc, char* argv[]);
+int runLogfBench(int argc, char* argv[]);
+int runRoundTripBench(int argc, char* argv[]);
+int runTimeBench(int argc, char* argv[]);
+int runLogFormatBench(int argc, char* argv[]);
+int runIdleBench(int argc, char* argv[]);
+int runSpawnBench(int argc, char* argv[]);
+int runSpawnChild(int argc, char* argv[]);
+int runPoolBench(int argc, char* argv[]);
+int runPoolJob(int argc, char* argv[]);
+int runPoolWorker(int argc, char* argv[]);
+int runChildTableBench(int argc, char* argv[]);
+
+#endif // BENCH_H
@@ -0,0 +1,130 @@
+#include "bench.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static void printUsage(const char* prog) {
+    printf("Usage: %s <benchmark> [options]\n", prog);
+    printf("Benchmarks:\n");
+    printf("  counter    Counter increment throughput per mode, 1-64 threads and processes\n");
+    printf("  rmw        Counter read-modify-write throughput and lost updates, racy vs atomic\n");
+    printf("  wait       Counter store-to-wakeup latency, futex waitForChange vs polling\n");
+    printf("  registry   Named counter lookups, read-only attach, and increment throughput\n");
+    printf("  checkpoint Counter checkpoint write latency and restart recovery\n");
+    printf("  time       Logger timestamp formatting cost\n");
+    printf("  logformat  Bytes per event, text vs binary log records\n");
+    printf("  idle       Wakeups and CPU of an idle master + 16 slaves, polling vs scheduler\n");
+    printf("  spawn      Child launch latency and parent stall, fork vs posix_spawn, by parent RSS\n");
+    printf("  pool       Child job throughput, process per job vs persistent worker pool\n");
+    printf("  childtable Child table bookkeeping with 10k+ children, vector vs indexed\n");
+    printf("  logger     Logger::logWithTime throughput and tail latency, /dev/null and tmpfs\n");
+    printf("  logf       Logger::logf cost and heap allocations per call; fails if any\n");
+    printf("  roundtrip  ProcessManager launch-to-reap latency per launch method\n");
+    printf("Options:\n");
+    printf("  --json=PATH  also write the results as JSON (counter, time, logger, logf, roundtrip)\n");
+}
+
+// Benchmarks that call recordResult(); --json means nothing to the others
+static bool supportsJson(const char* benchmark) {
+    const char* supported[] = {"counter", "time", "logger", "logf", "roundtrip"};
+    for (const char* name : supported) {
+        if (strcmp(benchmark, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int runBenchmark(int argc, char* argv[]) {
+    if (strcmp(argv[1], "counter") == 0) {
+        return runCounterBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "rmw") == 0) {
+        return runCounterRmwBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "checkpoint") == 0) {
+        return runCheckpointBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "registry") == 0) {
+        return runCounterRegistryBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "wait") == 0) {
+        return runCounterWaitBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "time") == 0) {
+        return runTimeBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "logformat") == 0) {
+        return runLogFormatBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "idle") == 0) {
+        return runIdleBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "spawn") == 0) {
+        return runSpawnBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "spawn-child") == 0) {
+        return runSpawnChild(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "pool") == 0) {
+        return runPoolBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "childtable") == 0) {
+        return runChildTableBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "pool-job") == 0) {
+        return runPoolJob(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "pool-worker") == 0) {
+        return runPoolWorker(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "logger") == 0) {
+        return runLoggerBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "logf") == 0) {
+        return runLogfBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "roundtrip") == 0) {
+        return runRoundTripBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "--child") == 0) {
+        // Children launched by ProcessManager in the roundtrip benchmark
+        return 0;
+    }
+    
+    printUsage(argv[0]);
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    // --json=PATH may appear anywhere; the benchmarks never see it
+    std::string jsonPath;
+    std::vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--json=", 7) == 0) {
+            jsonPath = argv[i] + 7;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    args.push_back(nullptr);
+    int count = static_cast<int>(args.size()) - 1;
+    if (count < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    if (!jsonPath.empty() && !supportsJson(args[1])) {
+        fprintf(stderr, "%s does not record results; --json is only supported by "
+                        "counter, time, logger, logf and roundtrip\n", args[1]);
+        return 1;
+    }
+    
+    int status = runBenchmark(count, args.data());
+    if (status == 0 && !jsonPath.empty() &&
+        !writeResultsJson(jsonPath, args[1], count - 2, args.data() + 2)) {
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,221 @@
+#include "bench.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int kMaxWorkers = 256;
+
+struct BenchResult {
+    std::string name;
+    BenchParams params;
+    BenchMetrics metrics;
+};
+
+std::vector<BenchResult> recordedResults;
+
+// Lives in anonymous shared memory so forked workers can report back
+struct RunControl {
+    std::atomic<int> ready;
+    std::atomic<bool> go;
+    std::atomic<bool> stop;
+    alignas(64) std::atomic<long long> ops[kMaxWorkers];
+};
+
+void workerLoop(RunControl* ctl, int index, const std::function<void()>& op) {
+    ctl->ready.fetch_add(1);
+    while (!ctl->go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    
+    long long done = 0;
+    while (!ctl->stop.load(std::memory_order_relaxed)) {
+        // Check the stop flag every few operations to keep it off the hot path
+        for (int i = 0; i < 64; i++) {
+            op();
+        }
+        done += 64;
+    }
+    ctl->ops[index].store(done);
+}
+
+} // namespace
+
+ContentionResult runContention(int workers, bool useProcesses, int durationMs,
+                               const std::function<void()>& op) {
+    ContentionResult result = {0, 0.0};
+    if (workers <= 0 || workers > kMaxWorkers) {
+        return result;
+    }
+    
+    RunControl* ctl = nullptr;
+#ifdef _WIN32
+    if (useProcesses) {
+        return result;
+    }
+    ctl = new RunControl();
+#else
+    void* mem = mmap(NULL, sizeof(RunControl), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return result;
+    }
+    ctl = new (mem) RunControl();
+#endif
+    ctl->ready.store(0);
+    ctl->go.store(false);
+    ctl->stop.store(false);
+    for (int i = 0; i < kMaxWorkers; i++) {
+        ctl->ops[i].store(0);
+    }
+    
+    std::vector<std::thread> threads;
+#ifndef _WIN32
+    std::vector<pid_t> pids;
+#endif
+    
+    for (int i = 0; i < workers; i++) {
+#ifndef _WIN32
+        if (useProcesses) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                workerLoop(ctl, i, op);
+                _exit(0);
+            } else if (pid > 0) {
+                pids.push_back(pid);
+            } else {
+                perror("fork");
+            }
+            continue;
+        }
+#endif
+        threads.emplace_back(workerLoop, ctl, i, std::cref(op));
+    }
+    
+    int started = useProcesses ? 0 : workers;
+#ifndef _WIN32
+    if (useProcesses) {
+        started = static_cast<int>(pids.size());
+    }
+#endif
+    while (ctl->ready.load() < started) {
+        std::this_thread::yield();
+    }
+    
+    auto begin = std::chrono::steady_clock::now();
+    ctl->go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::milliseconds(durationMs));
+    ctl->stop.store(true);
+    auto end = std::chrono::steady_clock::now();
+    
+    for (auto& t : threads) {
+        t.join();
+    }
+#ifndef _WIN32
+    for (pid_t pid : pids) {
+        int status;
+        waitpid(pid, &status, 0);
+    }
+#endif
+    
+    for (int i = 0; i < workers; i++) {
+        result.ops += ctl->ops[i].load();
+    }
+    result.seconds = std::chrono::duration<double>(end - begin).count();
+    
+#ifdef _WIN32
+    delete ctl;
+#else
+    ctl->~RunControl();
+    munmap(ctl, sizeof(RunControl));
+#endif
+    return result;
+}
+
+std::vector<int> defaultWorkerCounts() {
+    return {1, 2, 4, 8, 16, 32, 64};
+}
+
+namespace {
+
+void writeJsonString(FILE* f, const std::string& text) {
+    fputc('"', f);
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+} // namespace
+
+void recordResult(const std::string& name, const BenchParams& params, const BenchMetrics& metrics) {
+    recordedResults.push_back({name, params, metrics});
+}
+
+bool writeResultsJson(const std::string& path, const std::string& benchmark,
+                      int argc, char* argv[]) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        perror(path.c_str());
+        return false;
+    }
+    
+    fprintf(f, "{\n  \"benchmark\": ");
+    writeJsonString(f, benchmark);
+    fprintf(f, ",\n  \"args\": [");
+    for (int i = 0; i < argc; i++) {
+        fputs(i ? ", " : "", f);
+        writeJsonString(f, argv[i]);
+    }
+    fprintf(f, "],\n  \"unix_time\": %lld,\n  \"hardware_threads\": %u,\n  \"results\": [",
+            static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count()),
+            std::thread::hardware_concurrency());
+    
+    for (size_t i = 0; i < recordedResults.size(); i++) {
+        const BenchResult& r = recordedResults[i];
+        fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+        writeJsonString(f, r.name);
+        fprintf(f, ", \"params\": {");
+        for (size_t j = 0; j < r.params.size(); j++) {
+            fputs(j ? ", " : "", f);
+            writeJsonString(f, r.params[j].first);
+            fprintf(f, ": ");
+            writeJsonString(f, r.params[j].second);
+        }
+        fprintf(f, "}, \"metrics\": {");
+        for (size_t j = 0; j < r.metrics.size(); j++) {
+            fputs(j ? ", " : "", f);
+            writeJsonString(f, r.metrics[j].first);
+            // JSON has no NaN or infinity
+            double value = r.metrics[j].second;
+            if (std::isfinite(value)) {
+                fprintf(f, ": %.10g", value);
+            } else {
+                fprintf(f, ": null");
+            }
+        }
+        fprintf(f, "}}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
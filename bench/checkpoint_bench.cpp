@@ -0,0 +1,102 @@
+#include "bench.h"
+#include "counter_checkpoint.h"
+#include "latency_histogram.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+uint64_t nsSince(Clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start).count());
+}
+
+// Overwrites the value of the newest slot without fixing its checksum, as
+// a crash in the middle of write() would
+bool tearLatestSlot(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "r+b");
+    if (!f) {
+        perror(path.c_str());
+        return false;
+    }
+    
+    CheckpointFileLayout layout;
+    bool ok = fread(&layout, sizeof(layout), 1, f) == 1;
+    int latest = layout.sectors[0].slot.sequence > layout.sectors[1].slot.sequence ? 0 : 1;
+    long offset = static_cast<long>(offsetof(CheckpointFileLayout, sectors) +
+                                    latest * sizeof(CheckpointSector) +
+                                    offsetof(CheckpointSlot, value));
+    int64_t garbage = -1;
+    ok = ok && fseek(f, offset, SEEK_SET) == 0 && fwrite(&garbage, sizeof(garbage), 1, f) == 1;
+    fclose(f);
+    return ok;
+}
+
+} // namespace
+
+int runCheckpointBench(int argc, char* argv[]) {
+    std::string path = "labwork_bench_checkpoint.dat";
+    int writes = 200;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--writes") == 0 && i + 1 < argc) {
+            writes = atoi(argv[++i]);
+        }
+    }
+    
+    remove(path.c_str());
+    CounterCheckpoint checkpoint;
+    if (!checkpoint.open(path)) {
+        return 1;
+    }
+    
+    LatencyHistogram writeNs;
+    for (int i = 1; i <= writes; i++) {
+        Clock::time_point start = Clock::now();
+        if (!checkpoint.write(i)) {
+            return 1;
+        }
+        writeNs.record(nsSince(start));
+    }
+    
+    // Restart: a fresh mapping finds the last value from the two slots
+    checkpoint.close();
+    Clock::time_point start = Clock::now();
+    CounterCheckpoint restarted;
+    int64_t value = 0;
+    uint64_t sequence = 0;
+    bool found = restarted.open(path) && restarted.read(value, &sequence);
+    uint64_t recoverNs = nsSince(start);
+    restarted.close();
+    if (!found || value != writes) {
+        fprintf(stderr, "Recovered %lld, expected %d\n", static_cast<long long>(value), writes);
+        return 1;
+    }
+    
+    // A torn newest slot falls back to the one before it
+    int64_t fallback = 0;
+    bool torn = tearLatestSlot(path) && restarted.open(path) && restarted.read(fallback);
+    restarted.close();
+    remove(path.c_str());
+    if (!torn || fallback != writes - 1) {
+        fprintf(stderr, "After a torn write recovered %lld, expected %d\n",
+                static_cast<long long>(fallback), writes - 1);
+        return 1;
+    }
+    
+    printf("checkpoint file %s, %d writes\n", path.c_str(), writes);
+    printf("%-26s p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", "write + msync",
+           writeNs.percentile(0.5) / 1000.0, writeNs.percentile(0.99) / 1000.0,
+           writeNs.max() / 1000.0);
+    printf("%-26s %8.1f us (value %lld, sequence %llu)\n", "open + recover", recoverNs / 1000.0,
+           static_cast<long long>(value), static_cast<unsigned long long>(sequence));
+    printf("%-26s value %lld\n", "recover after torn write", static_cast<long long>(fallback));
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "bench.h"
+#include "child_table.h"
+#include "process_manager.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double nsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+ChildProcess makeChild(ProcessId pid) {
+    ChildProcess child = {};
+    child.pid = pid;
+    child.type = 1 + static_cast<int>(pid % 2);
+    return child;
+}
+
+// The table ProcessManager used before: linear find, erase from the middle
+// and a full scan to answer "anything active?"
+struct VectorTable {
+    std::vector<ChildProcess> children;
+    
+    void insert(const ChildProcess& child) { children.push_back(child); }
+    
+    void reap(ProcessId pid) {
+        for (auto it = children.begin(); it != children.end(); ++it) {
+            if (it->pid == pid) {
+                children.erase(it);
+                return;
+            }
+        }
+    }
+    
+    bool active() const {
+        for (const auto& child : children) {
+            if (child.pid != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+struct IndexedTable {
+    ChildTable table;
+    
+    void insert(const ChildProcess& child) { table.insert(child); }
+    
+    void reap(ProcessId pid) {
+        size_t slot = table.find(pid);
+        if (slot != ChildTable::kNoSlot) {
+            table.remove(slot);
+        }
+    }
+    
+    bool active() const { return table.active() > 0; }
+};
+
+// Inserts n children, then reaps them in random order, checking for
+// active children after every reap as the launch tick does
+template <typename Table>
+double bookkeepingNsPerChild(int n) {
+    std::vector<ProcessId> pids;
+    for (int i = 0; i < n; i++) {
+        pids.push_back(static_cast<ProcessId>(1000 + i));
+    }
+    std::mt19937 rng(42);
+    std::vector<ProcessId> order = pids;
+    std::shuffle(order.begin(), order.end(), rng);
+    
+    Table table;
+    auto start = Clock::now();
+    for (ProcessId pid : pids) {
+        table.insert(makeChild(pid));
+    }
+    int stillActive = 0;
+    for (ProcessId pid : order) {
+        table.reap(pid);
+        stillActive += table.active() ? 1 : 0;
+    }
+    double ns = nsSince(start);
+    if (stillActive != n - 1) {
+        fprintf(stderr, "unexpected active count\n");
+    }
+    return ns / n;
+}
+
+#ifndef _WIN32
+// Launches `total` real short-lived children with up to `inFlight` alive at
+// once; returns children reaped per second and the bookkeeping time per child
+template <typename Table>
+void runRealChildren(const char* name, int total, int inFlight) {
+    std::vector<std::string> args = {"/bin/true"};
+    Table table;
+    double bookkeepingNs = 0;
+    int launched = 0;
+    int reaped = 0;
+    
+    auto start = Clock::now();
+    while (reaped < launched || launched < total) {
+        while (launched < total && launched - reaped < inFlight) {
+            pid_t pid = ProcessManager::startProcess(args[0], args, LaunchMethod::Spawn);
+            if (pid <= 0) {
+                break;
+            }
+            auto t = Clock::now();
+            table.insert(makeChild(pid));
+            bookkeepingNs += nsSince(t);
+            launched++;
+        }
+        
+        pid_t pid = waitpid(-1, nullptr, 0);
+        if (pid <= 0) {
+            break;
+        }
+        auto t = Clock::now();
+        table.reap(pid);
+        table.active();
+        bookkeepingNs += nsSince(t);
+        reaped++;
+    }
+    double seconds = nsSince(start) / 1e9;
+    
+    printf("%-8s %8d %10d %14.0f %16.1f\n", name, total, inFlight, reaped / seconds,
+           bookkeepingNs / (reaped > 0 ? reaped : 1));
+}
+#endif
+
+} // namespace
+
+int runChildTableBench(int argc, char* argv[]) {
+    int realChildren = 10000;
+    int inFlight = 2000;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--children") == 0 && i + 1 < argc) {
+            realChildren = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--in-flight") == 0 && i + 1 < argc) {
+            inFlight = atoi(argv[++i]);
+        }
+    }
+    
+    printf("Table operations only (insert, reap in random order, active check)\n");
+    printf("%-8s %8s %16s\n", "table", "children", "ns per child");
+    for (int n : {1000, 10000, 50000}) {
+        printf("%-8s %8d %16.1f\n", "vector", n, bookkeepingNsPerChild<VectorTable>(n));
+        printf("%-8s %8d %16.1f\n", "indexed", n, bookkeepingNsPerChild<IndexedTable>(n));
+    }
+    
+    // Readers of the counts must not wait for the writer
+    ChildTable shared;
+    std::atomic<bool> done(false);
+    std::atomic<long> reads(0);
+    std::atomic<size_t> sink(0);
+    std::thread reader([&]() {
+        while (!done.load()) {
+            sink.store(shared.active() + shared.activeOfType(1), std::memory_order_relaxed);
+            reads.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    auto start = Clock::now();
+    for (int i = 0; i < 100000; i++) {
+        shared.remove(shared.insert(makeChild(static_cast<ProcessId>(i + 1))));
+    }
+    double writeNs = nsSince(start) / 100000;
+    done.store(true);
+    reader.join();
+    printf("indexed insert+remove with a concurrent count reader: %.1f ns, %ld reads\n",
+           writeNs, reads.load());
+    
+#ifndef _WIN32
+    printf("\nReal children (/bin/true)\n");
+    printf("%-8s %8s %10s %14s %16s\n", "table", "children", "in flight", "reaped/sec",
+           "bookkeeping ns");
+    runRealChildren<VectorTable>("vector", realChildren, inFlight);
+    runRealChildren<IndexedTable>("indexed", realChildren, inFlight);
+#endif
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include "bench.h"
+#include "counter.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <new>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+// Emulates the previous implementation: a process-local mutex around a
+// plain store into the shared word. Kept to show what the lock-free path buys.
+std::mutex legacyMutex;
+
+void legacyIncrement(Counter& counter) {
+    std::lock_guard<std::mutex> lock(legacyMutex);
+    int* word = static_cast<int*>(counter.getSharedMemory());
+    *word = *word + 1;
+}
+
+void printRow(const char* op, const char* mode, const char* workerKind, int workers,
+              const ContentionResult& r, long long lost) {
+    printf("%-10s %-10s %-9s %4d %14.0f %12lld\n", op, mode, workerKind, workers,
+           r.opsPerSecond(), lost);
+    recordResult(op, {{"mode", mode}, {"workers", workerKind}, {"n", std::to_string(workers)}},
+                 {{"ops_per_sec", r.opsPerSecond()}, {"lost", static_cast<double>(lost)}});
+}
+
+} // namespace
+
+int runCounterBench(int argc, char* argv[]) {
+    int durationMs = 200;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--duration-ms") == 0 && i + 1 < argc) {
+            durationMs = atoi(argv[++i]);
+        }
+    }
+    
+    Counter& counter = Counter::getInstance();
+    if (!counter.getSharedMemory()) {
+        fprintf(stderr, "Counter shared memory is not available\n");
+        return 1;
+    }
+    
+    printf("%-10s %-10s %-9s %4s %14s %12s\n", "op", "mode", "workers", "n", "ops/sec", "lost");
+    
+    struct ModeCase {
+        const char* name;
+        CounterMode mode;
+        bool legacy;
+    };
+    // Single runs first: once a sharded mode is enabled every reader
+    // aggregates the shards for the rest of the segment's lifetime.
+    const ModeCase cases[] = {
+        {"single", CounterMode::Single, false},
+        {"mutex", CounterMode::Single, true},
+        {"shard-cpu", CounterMode::ShardedPerCpu, false},
+        {"shard-proc", CounterMode::ShardedPerProcess, false},
+    };
+    
+    const char* kinds[] = {"threads", "processes"};
+    for (const ModeCase& c : cases) {
+        counter.setMode(c.mode);
+        for (int k = 0; k < 2; k++) {
+            bool useProcesses = (k == 1);
+            for (int n : defaultWorkerCounts()) {
+                counter.setValue(0);
+                ContentionResult r;
+                if (c.legacy) {
+                    r = runContention(n, useProcesses, durationMs,
+                        [&counter]() { legacyIncrement(counter); });
+                } else {
+                    r = runContention(n, useProcesses, durationMs,
+                        [&counter]() { counter.increment(); });
+                }
+                printRow("increment", c.name, kinds[k], n, r, r.ops - counter.getValue());
+            }
+        }
+    }
+    
+    // Plain stores and loads of the shared value. The sharded modes above
+    // leave the shards active, so these include re-aggregating them.
+    counter.setMode(CounterMode::Single);
+    for (int k = 0; k < 2; k++) {
+        bool useProcesses = (k == 1);
+        for (int n : defaultWorkerCounts()) {
+            ContentionResult r = runContention(n, useProcesses, durationMs,
+                [&counter]() { counter.setValue(1); });
+            printRow("setValue", "single", kinds[k], n, r, 0);
+        }
+        for (int n : defaultWorkerCounts()) {
+            volatile int sink = 0;
+            ContentionResult r = runContention(n, useProcesses, durationMs,
+                [&counter, &sink]() { sink = counter.getValue(); });
+            printRow("getValue", "single", kinds[k], n, r, 0);
+        }
+    }
+    
+    return 0;
+}
+
+namespace {
+
+// Shared with forked workers: updates that gave up after their retries
+std::atomic<long long>* abandonedUpdates = nullptr;
+
+struct RmwCase {
+    const char* name;
+    bool mulDiv;   // op doubles then halves: the value must end where it started
+    void (*op)(Counter&);
+};
+
+void racyIncrement(Counter& counter) {
+    counter.setValue(counter.getValue() + 1);
+}
+
+void fetchAddIncrement(Counter& counter) {
+    counter.fetchAdd(1);
+}
+
+void updateIncrement(Counter& counter) {
+    int old;
+    if (!counter.update([](int v) { return v + 1; }, old)) {
+        abandonedUpdates->fetch_add(1);
+    }
+}
+
+void racyMulDiv(Counter& counter) {
+    counter.setValue(counter.getValue() * 2);
+    counter.setValue(counter.getValue() / 2);
+}
+
+void fetchMulDiv(Counter& counter) {
+    counter.fetchMul(2);
+    counter.fetchDiv(2);
+}
+
+} // namespace
+
+int runCounterRmwBench(int argc, char* argv[]) {
+    int durationMs = 200;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--duration-ms") == 0 && i + 1 < argc) {
+            durationMs = atoi(argv[++i]);
+        }
+    }
+    
+    Counter& counter = Counter::getInstance();
+    if (!counter.getSharedMemory()) {
+        fprintf(stderr, "Counter shared memory is not available\n");
+        return 1;
+    }
+    counter.setMode(CounterMode::Single);
+    
+#ifdef _WIN32
+    static std::atomic<long long> abandoned;
+    abandonedUpdates = &abandoned;
+#else
+    void* mem = mmap(NULL, sizeof(std::atomic<long long>), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    abandonedUpdates = new (mem) std::atomic<long long>(0);
+#endif
+    
+    // lost: increments missing from the final value. For the mul/div pairs
+    // the value starts at 1 and every pair is exact, so it must end at 1;
+    // lost is then how far it drifted.
+    printf("%-12s %-9s %4s %14s %12s %10s\n", "op", "workers", "n", "ops/sec", "lost", "abandoned");
+    
+    const RmwCase cases[] = {
+        {"get+set", false, racyIncrement},
+        {"fetchAdd", false, fetchAddIncrement},
+        {"update", false, updateIncrement},
+        {"get+set x/2", true, racyMulDiv},
+        {"fetchMul/Div", true, fetchMulDiv},
+    };
+    
+    const char* kinds[] = {"threads", "processes"};
+    for (const RmwCase& c : cases) {
+        for (int k = 0; k < 2; k++) {
+            for (int n : defaultWorkerCounts()) {
+                // 2^n must fit in an int while every worker sits between
+                // its multiply and its divide
+                if (c.mulDiv && n > 16) {
+                    continue;
+                }
+                
+                int start = c.mulDiv ? 1 : 0;
+                counter.setValue(start);
+                abandonedUpdates->store(0);
+                void (*op)(Counter&) = c.op;
+                ContentionResult r = runContention(n, k == 1, durationMs,
+                    [&counter, op]() { op(counter); });
+                
+                long long abandoned = abandonedUpdates->load();
+                long long lost = c.mulDiv ? std::llabs(counter.getValue() - 1LL)
+                                          : r.ops - abandoned - counter.getValue();
+                printf("%-12s %-9s %4d %14.0f %12lld %10lld\n", c.name, kinds[k], n,
+                       r.opsPerSecond(), lost, abandoned);
+            }
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "bench.h"
+#include "counter.h"
+#include "counter_registry.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double nsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+} // namespace
+
+int runCounterRegistryBench(int argc, char* argv[]) {
+    int names = 500;
+    int durationMs = 200;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--names") == 0 && i + 1 < argc) {
+            names = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--duration-ms") == 0 && i + 1 < argc) {
+            durationMs = atoi(argv[++i]);
+        }
+    }
+    
+    CounterRegistry& registry = CounterRegistry::getInstance();
+    if (!registry.isOpen()) {
+        fprintf(stderr, "Counter registry is not available\n");
+        return 1;
+    }
+    
+    std::vector<std::string> keys;
+    for (int i = 0; i < names; i++) {
+        keys.push_back("bench.counter." + std::to_string(i));
+    }
+    
+    // Counters outlive the process, so a rerun finds them instead
+    size_t before = registry.size();
+    Clock::time_point start = Clock::now();
+    std::vector<std::atomic<int64_t>*> counters;
+    for (const auto& key : keys) {
+        counters.push_back(registry.counter(key.c_str()));
+        if (!counters.back()) {
+            fprintf(stderr, "Could not add %s, registry has %zu counters\n", key.c_str(),
+                    registry.size());
+            return 1;
+        }
+    }
+    double createNs = nsSince(start) / names;
+    
+    std::vector<int> order(names);
+    for (int i = 0; i < names; i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(42));
+    
+    const int rounds = 200;
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i : order) {
+            counters[i]->fetch_add(1);
+            if (registry.find(keys[i].c_str()) != counters[i]) {
+                fprintf(stderr, "Lookup of %s returned another counter\n", keys[i].c_str());
+                return 1;
+            }
+        }
+    }
+    double findNs = nsSince(start) / (static_cast<double>(rounds) * names);
+    
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i : order) {
+            std::string missing = "missing." + std::to_string(i);
+            if (registry.find(missing.c_str())) {
+                fprintf(stderr, "Found %s, which was never added\n", missing.c_str());
+                return 1;
+            }
+        }
+    }
+    double missNs = nsSince(start) / (static_cast<double>(rounds) * names);
+    
+    printf("registry: %zu counters (%zu new), capacity %u, segment %zu KiB\n",
+           registry.size(), registry.size() - before, kCounterRegistryCapacity,
+           CounterRegistry::segmentSize() / 1024);
+    printf("%-24s %10.1f ns\n", "add or find", createNs);
+    printf("%-24s %10.1f ns\n", "find + increment", findNs);
+    printf("%-24s %10.1f ns\n", "find missing", missNs);
+    
+    // A second, read-only mapping sees the same values
+    CounterRegistry reader;
+    if (!reader.open(true)) {
+        fprintf(stderr, "Read-only attach failed\n");
+        return 1;
+    }
+    const std::atomic<int64_t>* seen = reader.find(keys[0].c_str());
+    if (!seen || seen->load() != counters[0]->load() || reader.counter("readonly.add")) {
+        fprintf(stderr, "Read-only view disagrees with the writer\n");
+        return 1;
+    }
+    printf("read-only attach: %s = %lld\n", keys[0].c_str(),
+           static_cast<long long>(seen->load()));
+    
+    // Increments on one named counter against the default Counter
+    printf("\n%-10s %-9s %4s %14s\n", "counter", "workers", "n", "ops/sec");
+    std::atomic<int64_t>* hot = counters[0];
+    Counter& counter = Counter::getInstance();
+    counter.setMode(CounterMode::Single);
+    for (bool useProcesses : {false, true}) {
+        for (int workers : {1, 4}) {
+            ContentionResult named = runContention(workers, useProcesses, durationMs, [hot]() {
+                hot->fetch_add(1);
+            });
+            ContentionResult single = runContention(workers, useProcesses, durationMs, [&counter]() {
+                counter.increment();
+            });
+            const char* kind = useProcesses ? "processes" : "threads";
+            printf("%-10s %-9s %4d %14.0f\n", "named", kind, workers, named.opsPerSecond());
+            printf("%-10s %-9s %4d %14.0f\n", "default", kind, workers, single.opsPerSecond());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "bench.h"
+#include "counter.h"
+#include "latency_histogram.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Shared between the writer and its waiters, which may be forked processes
+struct WaitControl {
+    std::atomic<int64_t> writeNs; // when the current value was stored
+    std::atomic<int> acks;
+    LatencyHistogram wakeLatency;
+};
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Follows the counter until it reaches `last`, recording how long after each
+// store this waiter noticed it. pollUs > 0 polls instead of blocking.
+void follow(WaitControl* ctl, int last, int pollUs) {
+    Counter& counter = Counter::getInstance();
+    int seen = 0;
+    while (seen < last) {
+        if (pollUs > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(pollUs));
+        } else if (!counter.waitForChange(seen, 1000)) {
+            continue;
+        }
+        
+        int value = counter.getValue();
+        if (value != seen) {
+            ctl->wakeLatency.record(static_cast<uint64_t>(nowNs() - ctl->writeNs.load()));
+            seen = value;
+            ctl->acks.fetch_add(1);
+        }
+    }
+}
+
+} // namespace
+
+int runCounterWaitBench(int argc, char* argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "wait benchmark needs fork()\n");
+    return 1;
+#else
+    int writes = 2000;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--writes") == 0 && i + 1 < argc) {
+            writes = atoi(argv[++i]);
+        }
+    }
+    
+    Counter& counter = Counter::getInstance();
+    if (!counter.getSharedMemory()) {
+        fprintf(stderr, "Counter shared memory is not available\n");
+        return 1;
+    }
+    counter.setMode(CounterMode::Single);
+    
+    void* mem = mmap(NULL, sizeof(WaitControl), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    WaitControl* ctl = new (mem) WaitControl();
+    
+    printf("%-12s %-9s %7s %10s %10s %10s %10s\n",
+           "waiter", "kind", "waiters", "p50 us", "p99 us", "max us", "wakeups");
+    
+    struct WaitCase {
+        const char* name;
+        int pollUs;
+    };
+    const WaitCase cases[] = {{"futex", 0}, {"poll 1ms", 1000}};
+    const char* kinds[] = {"threads", "processes"};
+    
+    for (const WaitCase& c : cases) {
+        for (int k = 0; k < 2; k++) {
+            for (int waiters : {1, 4}) {
+                counter.setValue(0);
+                ctl->acks.store(0);
+                ctl->wakeLatency.reset();
+                
+                std::vector<std::thread> threads;
+                std::vector<pid_t> pids;
+                for (int w = 0; w < waiters; w++) {
+                    if (k == 0) {
+                        threads.emplace_back(follow, ctl, writes, c.pollUs);
+                    } else {
+                        pid_t pid = fork();
+                        if (pid == 0) {
+                            follow(ctl, writes, c.pollUs);
+                            _exit(0);
+                        }
+                        pids.push_back(pid);
+                    }
+                }
+                
+                // Let the waiters block first, then write one value at a time
+                // and wait for every waiter to see it before the next
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                for (int i = 1; i <= writes; i++) {
+                    ctl->writeNs.store(nowNs());
+                    counter.setValue(i);
+                    while (ctl->acks.load() < i * waiters) {
+                        std::this_thread::yield();
+                    }
+                }
+                
+                for (auto& t : threads) {
+                    t.join();
+                }
+                for (pid_t pid : pids) {
+                    waitpid(pid, nullptr, 0);
+                }
+                
+                printf("%-12s %-9s %7d %10.1f %10.1f %10.1f %10llu\n", c.name, kinds[k], waiters,
+                       ctl->wakeLatency.percentile(0.5) / 1000.0,
+                       ctl->wakeLatency.percentile(0.99) / 1000.0,
+                       ctl->wakeLatency.max() / 1000.0,
+                       static_cast<unsigned long long>(ctl->wakeLatency.count()));
+            }
+        }
+    }
+    
+    munmap(mem, sizeof(WaitControl));
+    return 0;
+#endif
+}
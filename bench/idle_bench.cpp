@@ -0,0 +1,119 @@
+#include "bench.h"
+#include "scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::atomic<long> work(0);
+
+// The loop runMaster()/runSlave() used before the scheduler: wake every
+// 10 ms and compare steady_clock deltas
+void legacyLoop(bool master, int durationMs) {
+    auto start = std::chrono::steady_clock::now();
+    auto lastIncrement = start;
+    auto lastLog = start;
+    auto lastLaunch = start;
+    
+    for (;;) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - start >= std::chrono::milliseconds(durationMs)) {
+            break;
+        }
+        if (now - lastIncrement >= std::chrono::milliseconds(300)) {
+            work.fetch_add(1);
+            lastIncrement = now;
+        }
+        if (master && now - lastLog >= std::chrono::milliseconds(1000)) {
+            work.fetch_add(1);
+            lastLog = now;
+        }
+        if (master && now - lastLaunch >= std::chrono::milliseconds(3000)) {
+            work.fetch_add(1);
+            lastLaunch = now;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+void schedulerLoop(bool master, int durationMs) {
+    Scheduler scheduler;
+    std::atomic<bool> running(true);
+    
+    scheduler.addPeriodic(std::chrono::milliseconds(300), []() { work.fetch_add(1); });
+    if (master) {
+        scheduler.addPeriodic(std::chrono::milliseconds(1000), []() { work.fetch_add(1); });
+        scheduler.addPeriodic(std::chrono::milliseconds(3000), []() { work.fetch_add(1); });
+    }
+    scheduler.addPeriodic(std::chrono::milliseconds(durationMs), [&scheduler]() {
+        scheduler.stop();
+    });
+    scheduler.run(running);
+}
+
+} // namespace
+
+int runIdleBench(int argc, char* argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "idle benchmark needs fork()\n");
+    return 1;
+#else
+    int durationMs = 5000;
+    int slaves = 16;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--duration-ms") == 0 && i + 1 < argc) {
+            durationMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--slaves") == 0 && i + 1 < argc) {
+            slaves = atoi(argv[++i]);
+        }
+    }
+    
+    printf("%-10s %6s %14s %12s\n", "loop", "procs", "wakeups/sec", "cpu ms");
+    
+    const char* names[] = {"polling", "scheduler"};
+    for (int mode = 0; mode < 2; mode++) {
+        int procs = slaves + 1;
+        for (int i = 0; i < procs; i++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                bool master = (i == 0);
+                if (mode == 0) {
+                    legacyLoop(master, durationMs);
+                } else {
+                    schedulerLoop(master, durationMs);
+                }
+                _exit(0);
+            } else if (pid < 0) {
+                perror("fork");
+            }
+        }
+        
+        long switches = 0;
+        double cpuMs = 0;
+        struct rusage usage;
+        int status;
+        while (wait4(-1, &status, 0, &usage) > 0) {
+            switches += usage.ru_nvcsw + usage.ru_nivcsw;
+            cpuMs += (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+                     (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+        }
+        
+        printf("%-10s %6d %14.1f %12.1f\n", names[mode], procs,
+               switches * 1000.0 / durationMs, cpuMs);
+    }
+    
+    return 0;
+#endif
+}
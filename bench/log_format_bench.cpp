@@ -0,0 +1,61 @@
+#include "bench.h"
+#include "log_format.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+int runLogFormatBench(int argc, char* argv[]) {
+    long long events = 1000000;
+    long long rate = 10000; // events per second, drives the timestamp deltas
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--events") == 0 && i + 1 < argc) {
+            events = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate = atoll(argv[++i]);
+        }
+    }
+    if (rate <= 0) {
+        rate = 1;
+    }
+    
+    const char* messages[] = {
+        "Master log",
+        "Launched child processes 1 and 2",
+        "Child 1 increased counter by 10",
+        "Child 2 multiplied counter by 2",
+    };
+    
+    BinaryLogEncoder encoder(123456);
+    uint8_t record[2 * kBinaryMaxRecord];
+    unsigned long long binaryBytes = 0;
+    unsigned long long textBytes = 0;
+    
+    int64_t baseUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < events; i++) {
+        int64_t ts = baseUs + i * 1000000 / rate;
+        const char* message = messages[i % 4];
+        binaryBytes += encoder.encodeEvent(record, ts, message, true, static_cast<int64_t>(i));
+        
+        BinaryLogRecord r;
+        r.type = kBinaryEvent;
+        r.pid = 123456;
+        r.timestampUs = ts;
+        r.hasCounter = true;
+        r.counterValue = i;
+        r.text = message;
+        textBytes += formatBinaryRecord(r).size() + 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    printf("events: %lld at %lld/sec\n", events, rate);
+    printf("text bytes/event:   %.1f\n", static_cast<double>(textBytes) / events);
+    printf("binary bytes/event: %.1f\n", static_cast<double>(binaryBytes) / events);
+    printf("reduction: %.1fx\n", static_cast<double>(textBytes) / binaryBytes);
+    printf("encode+format: %.1f ns/event\n", seconds * 1e9 / events);
+    return 0;
+}
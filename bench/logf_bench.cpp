@@ -0,0 +1,131 @@
+#include "bench.h"
+#include "logger.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+
+namespace {
+
+// Heap allocations made by the calling thread, so a logger writer thread
+// does not count against the caller
+thread_local unsigned long long threadAllocations = 0;
+
+typedef std::chrono::steady_clock Clock;
+
+struct LogfCase {
+    const char* format;
+    LogFormat logFormat;
+    bool async;
+};
+
+struct LogfCall {
+    const char* name;
+    bool mustNotAllocate;
+    std::function<void(Logger&, int)> call;
+};
+
+} // namespace
+
+// Counts every allocation in labwork_bench; the other benchmarks do not care
+void* operator new(size_t size) {
+    threadAllocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// Fails if logf allocates at all once warmed up
+int runLogfBench(int argc, char* argv[]) {
+    int calls = 100000;
+    const char* path = "/dev/null";
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        }
+    }
+    
+    const std::string input = "12345";
+    const LogfCall variants[] = {
+        {"logf int", true, [](Logger& logger, int i) {
+            logger.logf(LOG_FMT("Child {} started"), i);
+        }},
+        {"logf mixed", true, [&input](Logger& logger, int i) {
+            logger.logf(LOG_FMT("User set counter to {} (was {})"), input, i);
+        }},
+        // Longer than any std::string keeps inline, as at the child_job.cpp call sites
+        {"logWithTime", true, [](Logger& logger, int i) {
+            logger.logWithTime("Child 1 increased counter by 10", i);
+        }},
+        // What the call sites did before logf
+        {"concat", false, [](Logger& logger, int i) {
+            logger.logWithTime("Child " + std::to_string(i) + " started");
+        }},
+    };
+    const LogfCase cases[] = {
+        {"text", LogFormat::Text, false},
+        {"text", LogFormat::Text, true},
+        {"binary", LogFormat::Binary, false},
+    };
+    
+    Logger& logger = Logger::getInstance();
+    bool allocated = false;
+    printf("%-7s %-6s %-12s %10s %12s\n", "format", "mode", "call", "ns/call", "allocs/call");
+    
+    for (const LogfCase& c : cases) {
+        LogOptions options;
+        options.format = c.logFormat;
+        options.async = c.async;
+        if (!logger.initialize(path, options)) {
+            fprintf(stderr, "Cannot log to %s\n", path);
+            return 1;
+        }
+        
+        const char* mode = c.async ? "async" : "sync";
+        for (const LogfCall& variant : variants) {
+            // First calls set up per-thread state and intern messages
+            for (int i = 0; i < 100; i++) {
+                variant.call(logger, i);
+            }
+            
+            unsigned long long before = threadAllocations;
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < calls; i++) {
+                variant.call(logger, i);
+            }
+            double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() /
+                        calls;
+            double allocs = static_cast<double>(threadAllocations - before) / calls;
+            
+            printf("%-7s %-6s %-12s %10.1f %12.2f\n", c.format, mode, variant.name, ns, allocs);
+            recordResult("logf", {{"format", c.format}, {"mode", mode}, {"call", variant.name}},
+                         {{"ns_per_call", ns}, {"allocs_per_call", allocs}});
+            if (variant.mustNotAllocate && allocs > 0) {
+                allocated = true;
+            }
+        }
+        logger.flush();
+        logger.close();
+    }
+    
+    if (allocated) {
+        fprintf(stderr, "logf allocated on the hot path\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "bench.h"
+#include "logger.h"
+#include "latency_histogram.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct LoggerCase {
+    const char* target;
+    const char* path;
+    bool async;
+};
+
+} // namespace
+
+int runLoggerBench(int argc, char* argv[]) {
+    int calls = 20000; // per thread
+    const char* tmpfsPath = "/dev/shm/labwork_bench.log";
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tmpfs-file") == 0 && i + 1 < argc) {
+            tmpfsPath = argv[++i];
+        }
+    }
+    
+    const LoggerCase cases[] = {
+        {"/dev/null", "/dev/null", false},
+        {"/dev/null", "/dev/null", true},
+        {"tmpfs", tmpfsPath, false},
+        {"tmpfs", tmpfsPath, true},
+    };
+    
+    Logger& logger = Logger::getInstance();
+    printf("%-10s %-6s %7s %14s %10s %10s %10s %10s\n", "target", "mode", "threads",
+           "calls/sec", "p50 us", "p99 us", "p999 us", "max us");
+    
+    for (const LoggerCase& c : cases) {
+        for (int threads : {1, 4}) {
+            remove(tmpfsPath);
+            LogOptions options;
+            options.async = c.async;
+            if (!logger.initialize(c.path, options)) {
+                fprintf(stderr, "Cannot log to %s\n", c.path);
+                return 1;
+            }
+            
+            // Each thread keeps its own histogram so recording never contends
+            std::vector<LatencyHistogram> latency(threads);
+            Clock::time_point start = Clock::now();
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&logger, &latency, t, calls]() {
+                    for (int i = 0; i < calls; i++) {
+                        Clock::time_point before = Clock::now();
+                        logger.logWithTime("Bench log", i);
+                        latency[t].record(static_cast<uint64_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                Clock::now() - before).count()));
+                    }
+                });
+            }
+            for (auto& w : workers) {
+                w.join();
+            }
+            // Throughput counts until the records are written, not just queued
+            logger.flush();
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            logger.close();
+            
+            LatencyHistogram total;
+            for (const auto& h : latency) {
+                total.merge(h);
+            }
+            double callsPerSec = static_cast<double>(threads) * calls / seconds;
+            const char* mode = c.async ? "async" : "sync";
+            printf("%-10s %-6s %7d %14.0f %10.2f %10.2f %10.2f %10.2f\n", c.target, mode, threads,
+                   callsPerSec, total.percentile(0.5) / 1000.0, total.percentile(0.99) / 1000.0,
+                   total.percentile(0.999) / 1000.0, total.max() / 1000.0);
+            recordResult("logWithTime",
+                         {{"target", c.target}, {"mode", mode}, {"threads", std::to_string(threads)}},
+                         {{"calls_per_sec", callsPerSec},
+                          {"p50_ns", static_cast<double>(total.percentile(0.5))},
+                          {"p99_ns", static_cast<double>(total.percentile(0.99))},
+                          {"p999_ns", static_cast<double>(total.percentile(0.999))},
+                          {"max_ns", static_cast<double>(total.max())}});
+        }
+    }
+    remove(tmpfsPath);
+    
+    // Formatting the timestamp alone, which every logWithTime pays
+    const long long iterations = 1000000;
+    Clock::time_point start = Clock::now();
+    size_t length = 0;
+    for (long long i = 0; i < iterations; i++) {
+        length += logger.getCurrentTime(true).size();
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    printf("\ngetCurrentTime %.1f ns/call (%zu bytes)\n", ns,
+           static_cast<size_t>(length / iterations));
+    recordResult("getCurrentTime", {{"iterations", std::to_string(iterations)}},
+                 {{"ns_per_call", ns}});
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "bench.h"
+#include "counter.h"
+#include "process_manager.h"
+#include "worker_pool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// The type-1 job without logging, so the numbers show dispatch overhead
+void benchJob(int type) {
+    if (type == 1) {
+        Counter::getInstance().add(10);
+    }
+}
+
+#ifndef _WIN32
+std::string selfPath() {
+    char path[1024];
+    ssize_t count = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (count == -1) {
+        return "";
+    }
+    path[count] = '\0';
+    return std::string(path);
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+} // namespace
+
+int runPoolJob(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+    benchJob(1);
+    return 0;
+}
+
+int runPoolWorker(int argc, char* argv[]) {
+    if (argc < 2) {
+        return 1;
+    }
+    return WorkerPool::serve(argv[0], atoi(argv[1]), benchJob);
+}
+
+int runPoolBench(int argc, char* argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "pool benchmark needs POSIX process APIs\n");
+    return 1;
+#else
+    int jobs = 20000;
+    int processJobs = 500;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--process-jobs") == 0 && i + 1 < argc) {
+            processJobs = atoi(argv[++i]);
+        }
+    }
+    
+    std::string path = selfPath();
+    if (path.empty()) {
+        fprintf(stderr, "cannot resolve /proc/self/exe\n");
+        return 1;
+    }
+    
+    printf("%-16s %8s %8s %14s\n", "dispatch", "workers", "jobs", "jobs/sec");
+    
+    for (int workers : {1, 2, 4, 8}) {
+        // One new process per job, at most `workers` running at a time
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::string> args = {path, "pool-job"};
+        int running = 0;
+        for (int i = 0; i < processJobs; i++) {
+            if (running == workers) {
+                waitpid(-1, nullptr, 0);
+                running--;
+            }
+            if (ProcessManager::startProcess(path, args, LaunchMethod::Spawn) > 0) {
+                running++;
+            }
+        }
+        while (running > 0 && waitpid(-1, nullptr, 0) > 0) {
+            running--;
+        }
+        printf("%-16s %8d %8d %14.0f\n", "process per job", workers, processJobs,
+               processJobs / secondsSince(start));
+        
+        // Persistent pool fed through the shared queue
+        WorkerPool pool;
+        if (!pool.start(workers, {path, "pool-worker"}, LaunchMethod::Spawn)) {
+            fprintf(stderr, "failed to start worker pool\n");
+            return 1;
+        }
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < jobs; i++) {
+            while (!pool.submit(1)) {
+                pool.waitForCompleted(pool.completed() + 1, 100);
+            }
+        }
+        if (!pool.waitForCompleted(jobs, 30000)) {
+            fprintf(stderr, "worker pool did not finish\n");
+        }
+        printf("%-16s %8d %8d %14.0f\n", "worker pool", workers, jobs,
+               jobs / secondsSince(start));
+        pool.stop();
+    }
+    
+    return 0;
+#endif
+}
@@ -0,0 +1,90 @@
+#include "bench.h"
+#include "latency_histogram.h"
+#include "process_manager.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Waits until the event loop has reaped every launched child
+bool waitForReaped(ProcessManager& pm, uint64_t launched, int timeoutMs) {
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (pm.getJobStats().completed < launched) {
+        if (Clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+} // namespace
+
+// Each child is this binary run as "--child 1", which exits right away, so
+// the numbers are ProcessManager's own launch, exit notification and reap
+int runRoundTripBench(int argc, char* argv[]) {
+    int launches = 200;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--launches") == 0 && i + 1 < argc) {
+            launches = atoi(argv[++i]);
+        }
+    }
+    
+    ProcessManager& pm = ProcessManager::getInstance();
+    pm.setChildMode(ChildMode::Process);
+    
+    printf("%-8s %8s %10s %10s %10s %10s %8s\n", "launch", "children", "p50 us", "p99 us",
+           "max us", "mean us", "failed");
+    
+    struct MethodCase {
+        const char* name;
+        LaunchMethod method;
+    };
+    const MethodCase methods[] = {{"spawn", LaunchMethod::Spawn}, {"fork", LaunchMethod::Fork}};
+    
+    for (const MethodCase& m : methods) {
+#ifdef _WIN32
+        if (m.method == LaunchMethod::Fork) {
+            continue;
+        }
+#endif
+        pm.setLaunchMethod(m.method);
+        JobStats before = pm.getJobStats();
+        LatencyHistogram roundTrip;
+        
+        for (int i = 0; i < launches; i++) {
+            Clock::time_point start = Clock::now();
+            if (!pm.launchChildProcess(1)) {
+                fprintf(stderr, "launchChildProcess failed\n");
+                return 1;
+            }
+            if (!waitForReaped(pm, before.launched + i + 1, 5000)) {
+                fprintf(stderr, "Child was not reaped within 5 s\n");
+                return 1;
+            }
+            roundTrip.record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+        }
+        
+        uint64_t failed = pm.getJobStats().failed - before.failed;
+        double meanUs = roundTrip.sum() / 1000.0 / roundTrip.count();
+        printf("%-8s %8d %10.1f %10.1f %10.1f %10.1f %8llu\n", m.name, launches,
+               roundTrip.percentile(0.5) / 1000.0, roundTrip.percentile(0.99) / 1000.0,
+               roundTrip.max() / 1000.0, meanUs, static_cast<unsigned long long>(failed));
+        recordResult("launch_to_reap", {{"launch", m.name}, {"children", std::to_string(launches)}},
+                     {{"p50_ns", static_cast<double>(roundTrip.percentile(0.5))},
+                      {"p99_ns", static_cast<double>(roundTrip.percentile(0.99))},
+                      {"max_ns", static_cast<double>(roundTrip.max())},
+                      {"mean_ns", meanUs * 1000.0},
+                      {"failed", static_cast<double>(failed)}});
+    }
+    
+    pm.cleanup();
+    return 0;
+}
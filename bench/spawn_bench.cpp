@@ -0,0 +1,158 @@
+#include "bench.h"
+#include "latency_histogram.h"
+#include "process_manager.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifndef _WIN32
+uint64_t elapsedNs(std::chrono::steady_clock::time_point since) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - since).count());
+}
+
+std::string selfPath() {
+    char path[1024];
+    ssize_t count = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (count == -1) {
+        return "";
+    }
+    path[count] = '\0';
+    return std::string(path);
+}
+#endif
+
+} // namespace
+
+// Runs in the spawned process: reports that it is up and exits
+int runSpawnChild(int argc, char* argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    return 1;
+#else
+    if (argc < 1) {
+        return 1;
+    }
+    int fd = atoi(argv[0]);
+    char byte = 1;
+    ssize_t rc = write(fd, &byte, 1);
+    return rc == 1 ? 0 : 1;
+#endif
+}
+
+int runSpawnBench(int argc, char* argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "spawn benchmark needs POSIX process APIs\n");
+    return 1;
+#else
+    int iterations = 50;
+    std::vector<size_t> rssSizesMb = {0, 64, 256, 1024};
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rss-mb") == 0 && i + 1 < argc) {
+            // Comma-separated list, e.g. 0,128,512
+            rssSizesMb.clear();
+            for (char* p = argv[++i]; *p; ) {
+                rssSizesMb.push_back(static_cast<size_t>(strtoul(p, &p, 10)));
+                if (*p == ',') {
+                    p++;
+                } else if (*p) {
+                    break;
+                }
+            }
+        }
+    }
+    
+    std::string path = selfPath();
+    if (path.empty()) {
+        fprintf(stderr, "cannot resolve /proc/self/exe\n");
+        return 1;
+    }
+    
+    // A second thread makes the parent multi-threaded like the master
+    std::atomic<bool> busy(true);
+    std::thread ticker([&busy]() {
+        while (busy.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    
+    // stall: how long the launching thread is blocked in the launch call
+    // ready: launch call to the child running main()
+    printf("%-6s %8s %12s %12s %12s %12s\n",
+           "method", "rss MB", "stall p50", "stall p99", "ready p50", "ready p99");
+    
+    const char* names[] = {"fork", "spawn"};
+    const LaunchMethod methods[] = {LaunchMethod::Fork, LaunchMethod::Spawn};
+    for (size_t rssMb : rssSizesMb) {
+        // Touch every page so it is resident and has page table entries
+        size_t bytes = rssMb << 20;
+        void* ballast = nullptr;
+        if (bytes > 0) {
+            ballast = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ballast == MAP_FAILED) {
+                perror("mmap");
+                continue;
+            }
+            memset(ballast, 1, bytes);
+        }
+        
+        for (int m = 0; m < 2; m++) {
+            LatencyHistogram stall;
+            LatencyHistogram ready;
+            
+            for (int i = 0; i < iterations; i++) {
+                int fds[2];
+                if (pipe(fds) == -1) {
+                    perror("pipe");
+                    break;
+                }
+                
+                std::vector<std::string> args = {path, "spawn-child", std::to_string(fds[1])};
+                auto start = std::chrono::steady_clock::now();
+                pid_t pid = ProcessManager::startProcess(path, args, methods[m]);
+                stall.record(elapsedNs(start));
+                close(fds[1]);
+                
+                char byte;
+                if (pid > 0 && read(fds[0], &byte, 1) == 1) {
+                    ready.record(elapsedNs(start));
+                }
+                close(fds[0]);
+                if (pid > 0) {
+                    waitpid(pid, nullptr, 0);
+                }
+            }
+            
+            printf("%-6s %8zu %9.1f us %9.1f us %9.1f us %9.1f us\n", names[m], rssMb,
+                   stall.percentile(0.5) / 1000.0, stall.percentile(0.99) / 1000.0,
+                   ready.percentile(0.5) / 1000.0, ready.percentile(0.99) / 1000.0);
+        }
+        
+        if (ballast) {
+            munmap(ballast, bytes);
+        }
+    }
+    
+    busy.store(false);
+    ticker.join();
+    return 0;
+#endif
+}
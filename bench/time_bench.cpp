@@ -0,0 +1,68 @@
+#include "bench.h"
+#include "logger.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace {
+
+// The previous Logger::getCurrentTime, kept as the baseline
+std::string legacyCurrentTime() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()
+    ) % 1000;
+    
+    std::stringstream ss;
+    char buffer[80];
+    struct tm* timeinfo = localtime(&time);
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
+    ss << buffer;
+    ss << "." << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+template <typename F>
+void measure(const char* name, long long iterations, F&& fn) {
+    // Keep results observable so the calls are not optimized away
+    volatile size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < iterations; i++) {
+        sink = sink + fn();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-22s %10.1f ns/call %14.0f calls/sec\n", name,
+           seconds * 1e9 / iterations, iterations / seconds);
+    recordResult(name, {{"iterations", std::to_string(iterations)}},
+                 {{"ns_per_call", seconds * 1e9 / iterations}, {"calls_per_sec", iterations / seconds}});
+}
+
+} // namespace
+
+int runTimeBench(int argc, char* argv[]) {
+    long long iterations = 2000000;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoll(argv[++i]);
+        }
+    }
+    
+    measure("legacy stringstream", iterations, []() {
+        return legacyCurrentTime().size();
+    });
+    measure("getCurrentTime", iterations, []() {
+        return Logger::getInstance().getCurrentTime(true).size();
+    });
+    measure("formatCurrentTime", iterations, []() {
+        char buffer[32];
+        return Logger::formatCurrentTime(buffer, sizeof(buffer), true);
+    });
+    
+    return 0;
+}
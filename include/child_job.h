@@ -0,0 +1,16 @@
+#ifndef CHILD_JOB_H
+#define CHILD_JOB_H
+
+#include <chrono>
+
+// The work of child jobs 1 and 2, split at its waits so the same code can
+// run blocking in a child process or as timer continuations in-process.
+
+// Runs step `step` (from 0) of a job and returns how long to wait before
+// the next step, or a negative duration once the job is done.
+std::chrono::milliseconds runChildJobStep(int type, int step);
+
+// Runs a whole job on the calling thread, sleeping through its waits
+void runChildJob(int type);
+
+#endif // CHILD_JOB_H
@@ -0,0 +1,82 @@
+#ifndef CHILD_TABLE_H
+#define CHILD_TABLE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef DWORD ProcessId;
+#else
+#include <sys/types.h>
+typedef pid_t ProcessId;
+#endif
+
+struct ChildProcess {
+#ifdef _WIN32
+    HANDLE handle;
+#endif
+    ProcessId pid;
+    int type; // 1 or 2
+    time_t startTime;
+    std::chrono::steady_clock::time_point started;
+#ifndef _WIN32
+    int pidfd; // -1 without pidfd support
+#endif
+};
+
+const int kMaxChildTypes = 8;
+
+// Running children, indexed for large fan-out. Entries live in slots that
+// are recycled through a free list, so insert and remove are O(1) and never
+// move other entries; a pid -> slot hash makes lookups O(1). The counts are
+// atomics updated on every change, so they can be read without the lock
+// that serializes inserts and removals.
+class ChildTable {
+public:
+    static const size_t kNoSlot = static_cast<size_t>(-1);
+    
+    ChildTable();
+    
+    // Writers must be serialized by the caller
+    size_t insert(const ChildProcess& child);
+    void remove(size_t slot);
+    void clear();
+    
+    size_t find(ProcessId pid) const; // kNoSlot if absent
+    ChildProcess& at(size_t slot) { return slots[slot].child; }
+    
+    // Calls f(slot, child) for every entry; f may remove the current slot
+    template <typename F>
+    void forEach(F f) {
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (slots[i].live) {
+                f(i, slots[i].child);
+            }
+        }
+    }
+    
+    // Lock-free
+    size_t active() const { return activeCount.load(std::memory_order_acquire); }
+    size_t activeOfType(int type) const;
+    
+private:
+    struct Slot {
+        ChildProcess child;
+        bool live;
+        size_t nextFree;
+    };
+    
+    std::vector<Slot> slots;
+    size_t freeHead;
+    std::unordered_map<ProcessId, size_t> slotByPid;
+    std::atomic<size_t> activeCount;
+    std::atomic<size_t> activeByType[kMaxChildTypes];
+};
+
+#endif // CHILD_TABLE_H
@@ -3,18 +3,88 @@
 
 #include <mutex>
 #include <atomic>
-#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <functional>
+
+const int kCounterShards = 64;
+const int kCounterUpdateRetries = 64;
+
+// One cache line per shard so that increments on different CPUs or
+// processes never write to the same line.
+struct alignas(64) CounterShard {
+    std::atomic<int> value;
+};
+
+// Layout of the shared memory segment. Every labwork process maps the same
+// segment, so the value must only be touched through atomic operations.
+//
+// Once any process switches to a sharded mode the logical value is
+// value + sum(shards). Absolute writes (setValue, exchange, compareExchange)
+// then rebias `value` against a snapshot of the shards instead of clearing
+// them, so increments that race with a write land either before or after it
+// and are never lost.
+//
+// `generation` is the futex word for waitForChange(). Writers only bump it
+// and issue a wake when `waiters` says someone is blocked, so writes with
+// nobody watching cost one extra shared load.
+struct CounterShared {
+    alignas(64) std::atomic<int> value;
+    std::atomic<int> shardsActive;
+    alignas(64) std::atomic<uint32_t> generation;
+    std::atomic<uint32_t> waiters;
+    CounterShard shards[kCounterShards];
+};
+
+enum class CounterMode {
+    Single,             // every increment hits the shared word
+    ShardedPerCpu,      // increments go to the slot of the current CPU
+    ShardedPerProcess   // increments go to a slot picked from the PID
+};
+
+static_assert(std::atomic<int>::is_always_lock_free,
+              "Counter needs lock-free atomics to share them between processes");
 
 class Counter {
 public:
     static Counter& getInstance();
     
     void increment();
+    int add(int delta);                              // returns the new value
+    int exchange(int newValue);                      // returns the old value
+    bool compareExchange(int& expected, int desired);
     void setValue(int newValue);
     int getValue();
     
-    // For shared memory between processes
+    // Read-modify-write operations on the logical value; each returns the
+    // value it replaced. Multiply and divide are CAS loops, so writers that
+    // get in between are retried against, never overwritten. fetchAdd's
+    // result is exact in Single mode and re-aggregated when sharded.
+    int fetchAdd(int delta);
+    int fetchMul(int factor);
+    int fetchDiv(int divisor); // divisor 0 leaves the value unchanged
+    
+    // Atomically replaces the value v with fn(v), retrying at most
+    // maxRetries times when another writer gets in between. fn may run
+    // more than once. Returns false, leaving the value alone, if every
+    // attempt lost; oldValue gets the value fn was last applied to.
+    bool update(const std::function<int(int)>& fn, int& oldValue,
+                int maxRetries = kCounterUpdateRetries);
+    
+    // Blocks until the value differs from oldValue or timeoutMs passes (no
+    // limit if negative). Works across processes: on Linux it sleeps on a
+    // futex in the shared segment, elsewhere it polls every millisecond.
+    // Returns false on timeout.
+    bool waitForChange(int oldValue, int timeoutMs);
+    
+    // Selects where this process sends increments. Pick the mode at startup;
+    // processes using different modes can share the segment.
+    void setMode(CounterMode mode);
+    CounterMode getMode() const;
+    void resetProcessShard();
+    
+    // The shared state in the counter registry, or nullptr if this process
+    // could not map it and counts on its own
     void* getSharedMemory();
     size_t getSharedMemorySize();
     
@@ -23,17 +93,15 @@ private:
     Counter(const Counter&) = delete;
     Counter& operator=(const Counter&) = delete;
     
-    std::atomic<int> value;
-    std::mutex mtx;
-    std::condition_variable cv;
-    
-#ifdef _WIN32
-    void* sharedMemory;
-    void* mapHandle;
-#else
-    int shm_fd;
-    void* sharedMemory;
-#endif
+    std::atomic<int>& incrementTarget();
+    int sumShards();
+    void notifyChange();
+    
+    // The registry's default entry, or localFallback if mapping failed
+    CounterShared* shared;
+    CounterShared localFallback;
+    CounterMode mode;
+    int processShard;
 };
 
 #endif // COUNTER_H
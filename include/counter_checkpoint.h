@@ -0,0 +1,72 @@
+#ifndef COUNTER_CHECKPOINT_H
+#define COUNTER_CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+
+const uint32_t kCheckpointMagic = 0x4c434b31; // "LCK1"
+const uint32_t kCheckpointVersion = 1;
+
+// A checkpoint is valid only if its checksum matches, so a write torn by a
+// crash leaves the other slot as the latest consistent value
+struct CheckpointSlot {
+    uint64_t sequence; // 0: never written
+    int64_t value;
+    int64_t wallTimeMs;
+    uint64_t checksum;
+};
+
+// Each slot gets its own 512-byte sector, so a torn sector write can only
+// damage the slot being written
+struct alignas(512) CheckpointSector {
+    CheckpointSlot slot;
+};
+
+struct CheckpointFileLayout {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t reserved;
+    int64_t createdMs;
+    CheckpointSector sectors[2];
+};
+
+// Counter value persisted in a file that is memory-mapped. write() fills
+// the slot holding the older checkpoint and msyncs it, so the newest
+// complete checkpoint always survives. read() compares the two slots
+// instead of replaying anything. Processes sharing the file serialize
+// writes with an exclusive file lock.
+class CounterCheckpoint {
+public:
+    CounterCheckpoint();
+    ~CounterCheckpoint();
+    CounterCheckpoint(const CounterCheckpoint&) = delete;
+    CounterCheckpoint& operator=(const CounterCheckpoint&) = delete;
+    
+    // Creates the file with a fresh header if it does not exist yet
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return file != nullptr; }
+    
+    // Newest valid checkpoint; false if there is none
+    bool read(int64_t& value, uint64_t* sequence = nullptr) const;
+    // Durable once this returns true. Unchanged values are not rewritten.
+    bool write(int64_t value);
+    
+    const std::string& getPath() const { return path; }
+    
+private:
+    static uint64_t checksum(const CheckpointSlot& slot);
+    int latestSlot() const; // -1 if neither slot is valid
+    
+    CheckpointFileLayout* file;
+    std::string path;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mapHandle;
+#else
+    int fd;
+#endif
+};
+
+#endif // COUNTER_CHECKPOINT_H
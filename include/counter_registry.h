@@ -0,0 +1,94 @@
+#ifndef COUNTER_REGISTRY_H
+#define COUNTER_REGISTRY_H
+
+#include "counter.h"
+#include "shared_segment.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+const uint32_t kCounterRegistryMagic = 0x4c435231; // "LCR1"
+const uint32_t kCounterRegistryVersion = 1;
+const uint32_t kCounterRegistryCapacity = 1024;    // entries, power of two
+const int kCounterNameMax = 40;                    // including the NUL
+
+enum CounterEntryState : uint32_t {
+    kCounterEntryEmpty = 0,
+    kCounterEntryClaimed = 1, // name being written
+    kCounterEntryReady = 2
+};
+
+// One named counter per cache line. The name is written once, before the
+// state turns Ready, and never changes after that.
+struct alignas(64) CounterEntry {
+    std::atomic<uint32_t> state;
+    uint32_t hash;
+    char name[kCounterNameMax];
+    std::atomic<int64_t> value;
+};
+
+static_assert(sizeof(CounterEntry) == 64, "CounterEntry must fill exactly one cache line");
+
+// Start of the registry segment; the entry table follows it. Fresh pages
+// are zero, which already is an empty table and a zero default counter, so
+// the creator only fills in the header and publishes the magic last.
+struct CounterRegistryHeader {
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t capacity;
+    std::atomic<uint32_t> used;
+    CounterShared defaultCounter; // what Counter::getInstance() works on
+};
+
+// Named 64-bit counters shared by every labwork process on the host, in an
+// open-addressing hash table with linear probing. Names are claimed with a
+// CAS on the entry state and entries are never removed, so lookups take no
+// locks and a found counter stays valid for the life of the mapping.
+class CounterRegistry {
+public:
+    // The process-wide read-write registry
+    static CounterRegistry& getInstance();
+    
+    CounterRegistry();
+    ~CounterRegistry();
+    CounterRegistry(const CounterRegistry&) = delete;
+    CounterRegistry& operator=(const CounterRegistry&) = delete;
+    
+    // Maps the segment, creating it unless readOnly. A read-only registry
+    // only needs read access to the segment and cannot add counters.
+    bool open(bool readOnly);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+    bool isReadOnly() const { return readOnly; }
+    
+    // Finds or adds a counter. Returns nullptr if the name does not fit in
+    // kCounterNameMax, the table is full, or the registry is read-only.
+    std::atomic<int64_t>* counter(const char* name);
+    // Returns nullptr if there is no such counter
+    const std::atomic<int64_t>* find(const char* name) const;
+    
+    void forEach(const std::function<void(const char* name, int64_t value)>& f) const;
+    size_t size() const;
+    
+    CounterShared* defaultCounter();
+    // Value the default counter starts at if this process ends up creating
+    // the segment, e.g. one restored from a checkpoint. Call it before
+    // getInstance() or open().
+    static void setInitialDefaultValue(int value);
+    // True if this process created (and so initialized) the segment
+    bool created() const { return createdSegment; }
+    
+    static size_t segmentSize();
+    
+private:
+    CounterEntry* lookup(const char* name, bool create) const;
+    
+    SharedSegment segment;
+    CounterRegistryHeader* header;
+    CounterEntry* entries;
+    bool readOnly;
+    bool createdSegment;
+};
+
+#endif // COUNTER_REGISTRY_H
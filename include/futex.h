@@ -0,0 +1,21 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <cstdint>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex words must be plain 32-bit integers");
+
+// Process-shared futex wait/wake on a 32-bit word, which may live in shared
+// memory. On Linux these are the raw FUTEX_WAIT/FUTEX_WAKE syscalls; other
+// systems fall back to polling the word every millisecond.
+
+// Sleeps while *word == expected, for at most timeoutMs (forever if < 0).
+// Returns false on timeout. Spurious returns are possible; callers recheck.
+bool futexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeoutMs);
+
+// Wakes up to count waiters (INT32_MAX for all)
+void futexWake(std::atomic<uint32_t>* word, int count);
+
+#endif // FUTEX_H
@@ -0,0 +1,45 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram of non-negative values (nanoseconds, typically):
+// each power of two is split into 16 sub-buckets, so any recorded value is
+// reported with at most 1/16 relative error. Recording is a couple of
+// relaxed atomic adds; readers may run concurrently with writers. It holds
+// no pointers, so it can live in shared memory.
+class LatencyHistogram {
+public:
+    static const int kSubBucketBits = 4;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kBuckets = kSubBuckets + (64 - kSubBucketBits) * kSubBuckets;
+    
+    LatencyHistogram();
+    
+    void record(uint64_t value);
+    void reset();
+    
+    uint64_t count() const;
+    uint64_t max() const;
+    uint64_t sum() const;
+    
+    // Upper bound of the bucket holding the q-quantile, q in [0, 1]
+    uint64_t percentile(double q) const;
+    
+    // Adds another histogram's counts to this one
+    void merge(const LatencyHistogram& other);
+    
+    static int bucketOf(uint64_t value);
+    static uint64_t bucketUpperBound(int bucket);
+    uint64_t bucketCount(int bucket) const;
+    
+private:
+    std::atomic<uint64_t> buckets[kBuckets];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> maxValue;
+    std::atomic<uint64_t> sumValue;
+};
+
+#endif // LATENCY_HISTOGRAM_H
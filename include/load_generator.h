@@ -0,0 +1,30 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+// What `labwork --load` drives. Rates are totals over every thread of
+// every load process; 0 turns an operation off.
+struct LoadOptions {
+    int threads;   // per load process
+    int processes;
+    double incrementsPerSec;
+    double logsPerSec;
+    double jobsPerSec;
+    std::chrono::milliseconds duration;
+    
+    LoadOptions();
+};
+
+// Runs the real Counter, Logger and ProcessManager code at fixed rates in
+// options.processes forked processes (one, in this process, on Windows).
+// Each load process calls setupProcess() first, then runs its threads
+// until the duration is up or running is cleared, and lets its child jobs
+// finish. Prints achieved throughput, latency percentiles and CPU usage;
+// returns the process exit status.
+int runLoad(const LoadOptions& options, std::atomic<bool>& running,
+            const std::function<bool()>& setupProcess);
+
+#endif // LOAD_GENERATOR_H
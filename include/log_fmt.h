@@ -0,0 +1,84 @@
+#ifndef LOG_FMT_H
+#define LOG_FMT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+// Format strings for Logger::logf, checked at compile time. "{}" takes the
+// next argument; "{{" and "}}" are literal braces. LOG_FMT makes the text
+// part of the argument's type, so logf can check it with static_assert:
+//
+//   logger.logf(LOG_FMT("Child {} started"), type);
+#define LOG_FMT(text)                                                    \
+    [] {                                                                 \
+        struct LogFormatString {                                         \
+            static constexpr std::string_view value() { return text; }   \
+        };                                                               \
+        return LogFormatString();                                        \
+    }()
+
+// Number of "{}" in format, or -1 if it has a brace that is not part of
+// one of them and not doubled
+constexpr int countLogPlaceholders(std::string_view format) {
+    int count = 0;
+    for (size_t i = 0; i < format.size(); i++) {
+        char next = i + 1 < format.size() ? format[i + 1] : '\0';
+        if (format[i] == '{' && (next == '{' || next == '}')) {
+            count += next == '}' ? 1 : 0;
+            i++;
+        } else if (format[i] == '}' && next == '}') {
+            i++;
+        } else if (format[i] == '{' || format[i] == '}') {
+            return -1;
+        }
+    }
+    return count;
+}
+
+// One logf argument. Strings are referenced, not copied.
+struct LogArg {
+    enum Kind { Signed, Unsigned, Char, Text };
+    
+    Kind kind = Text;
+    int64_t signedValue = 0;
+    uint64_t unsignedValue = 0;
+    const char* text = "";
+    size_t length = 0;
+};
+
+// Integers (char prints as a character, bool as true/false) and anything
+// that converts to std::string_view; other types do not compile
+template <typename T>
+LogArg makeLogArg(const T& value) {
+    LogArg arg;
+    if constexpr (std::is_same<T, bool>::value) {
+        arg.text = value ? "true" : "false";
+        arg.length = value ? 4 : 5;
+    } else if constexpr (std::is_same<T, char>::value) {
+        arg.kind = LogArg::Char;
+        arg.signedValue = value;
+    } else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value) {
+        arg.kind = LogArg::Signed;
+        arg.signedValue = value;
+    } else if constexpr (std::is_integral<T>::value) {
+        arg.kind = LogArg::Unsigned;
+        arg.unsignedValue = value;
+    } else if constexpr (std::is_pointer<T>::value &&
+                         std::is_convertible<T, std::string_view>::value) {
+        // Unlike std::string_view itself, a null pointer is fine
+        std::string_view view = value ? std::string_view(value) : std::string_view("(null)");
+        arg.text = view.data();
+        arg.length = view.size();
+    } else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+        std::string_view view = value;
+        arg.text = view.data();
+        arg.length = view.size();
+    } else {
+        static_assert(sizeof(T) == 0, "logf takes integers and strings");
+    }
+    return arg;
+}
+
+#endif // LOG_FMT_H
@@ -0,0 +1,126 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Compact binary log records. Every record starts with one tag byte; the
+// remaining fields are LEB128 varints:
+//
+//   tag                 0xA0 | type | flags
+//   pid
+//   timestamp           microseconds since the epoch if kBinaryAbsoluteTime
+//                       is set, otherwise a zigzag delta from the previous
+//                       record of the same pid
+//   Event:  message id, [zigzag counter value if kBinaryHasCounter]
+//   Define: message id, length, text     (binds an id to a message)
+//   Text:   length, text                 (free-form line, no newline; with
+//                                         kBinaryPrefixedText it is shown
+//                                         with the logWithTime prefix)
+//
+// Message ids are interned per process. Writers restart the time base and
+// re-send definitions every kBinaryResyncUs, so any window of that length
+// can be decoded without the records before it.
+
+enum BinaryRecordType : uint8_t {
+    kBinaryDefine = 1,
+    kBinaryEvent = 2,
+    kBinaryText = 3
+};
+
+const uint8_t kBinaryTagMarker = 0xA0;
+const uint8_t kBinaryTypeMask = 0x03;
+const uint8_t kBinaryHasCounter = 0x04;   // Event
+const uint8_t kBinaryPrefixedText = 0x04; // Text
+const uint8_t kBinaryAbsoluteTime = 0x08;
+
+const int64_t kBinaryResyncUs = 10 * 1000000LL;
+// A Define plus its Event must fit one LogRing slot (244 bytes)
+const size_t kBinaryMaxText = 180;
+const size_t kBinaryMaxRecord = kBinaryMaxText + 40;
+// Messages interned per process; events with any other message are
+// written as Text records, so one-off lines cannot grow the tables
+const size_t kBinaryMaxMessages = 1024;
+
+struct BinaryLogRecord {
+    uint8_t type;
+    int32_t pid;
+    int64_t timestampUs;
+    uint32_t messageId;
+    bool hasCounter;
+    int64_t counterValue;
+    bool prefixed;      // Text with the timestamp and pid prefix
+    std::string text;   // Define/Text payload; for Event the resolved message
+};
+
+// Encodes the records of one process. Not thread-safe.
+class BinaryLogEncoder {
+public:
+    explicit BinaryLogEncoder(int32_t pid);
+    
+    // Each call writes one or two records (a Define precedes the first use
+    // of a message in the current time base) and returns the byte count.
+    // `out` must hold at least 2 * kBinaryMaxRecord bytes.
+    size_t encodeEvent(uint8_t* out, int64_t timestampUs, std::string_view message,
+                       bool hasCounter, int64_t counterValue);
+    size_t encodeText(uint8_t* out, int64_t timestampUs, const std::string& text);
+    size_t encodeText(uint8_t* out, int64_t timestampUs, const char* text, size_t length);
+    // A Text record that decodes as a logWithTime line, timestamp and pid
+    // included, for lines formatted by the writer
+    size_t encodePrefixedText(uint8_t* out, int64_t timestampUs, const char* text,
+                              size_t length);
+    
+    // Starts a new time base with the next record, which then carries an
+    // absolute time and redefines its message. For when encoded records
+    // were lost, which may have taken a Define or the delta base with them.
+    void forceResync() { resyncPending = true; }
+    
+private:
+    bool needsResync(int64_t timestampUs) const;
+    size_t encodeHeader(uint8_t* out, uint8_t type, uint8_t flags, int64_t timestampUs);
+    
+    struct Interned {
+        uint32_t id;
+        uint64_t epoch; // time base in which it was last defined
+    };
+    
+    int32_t pid;
+    // Keys point into messageText, whose elements never move
+    std::unordered_map<std::string_view, Interned> messages;
+    std::deque<std::string> messageText;
+    uint32_t nextId;
+    uint64_t epoch;
+    int64_t epochStartUs;
+    int64_t lastTimestampUs;
+    bool resyncPending;
+};
+
+// Decodes a stream that may interleave records from many processes
+class BinaryLogDecoder {
+public:
+    // Decodes one record from data[0, size). Returns the bytes consumed, 0 if
+    // the record is incomplete, or -1 if the data is not a valid record.
+    long decode(const uint8_t* data, size_t size, BinaryLogRecord& record);
+    
+    // Whether the record's timestamp is known, i.e. its pid's time base was
+    // seen in the decoded part of the stream
+    bool hasTimeBase(int32_t pid) const;
+    
+private:
+    struct PidState {
+        int64_t lastTimestampUs = 0;
+        bool haveBase = false;
+        std::unordered_map<uint32_t, std::string> messages;
+    };
+    
+    std::unordered_map<int32_t, PidState> pids;
+};
+
+// Renders a record in the text format of Logger::logWithTime
+std::string formatBinaryRecord(const BinaryLogRecord& record);
+
+#endif // LOG_FORMAT_H
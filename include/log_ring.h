@@ -0,0 +1,54 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+const size_t kLogRecordSize = 256;
+
+struct LogRecordView {
+    const char* data;
+    size_t length;
+};
+
+// Bounded multi-producer single-consumer ring of fixed-size log records.
+// Producers claim a slot with one CAS on the tail and never block each
+// other; the single consumer reads records in order and releases them in
+// bulk after they have been written out.
+class LogRing {
+public:
+    explicit LogRing(size_t capacity); // rounded up to a power of two
+    
+    // Copies the record into the ring. Records longer than a slot are
+    // truncated. Returns false if the ring is full.
+    bool tryPush(const char* data, size_t length);
+    
+    // Consumer side: fills up to `max` views of the oldest records without
+    // removing them. The views stay valid until release().
+    size_t peek(LogRecordView* out, size_t max);
+    void release(size_t count);
+    
+    size_t capacity() const { return mask + 1; }
+    size_t sizeApprox() const;
+    
+    // Monotonic positions: every record claimed before tailPosition() was
+    // read has been written out once headPosition() reaches that value.
+    size_t tailPosition() const { return tail.load(std::memory_order_acquire); }
+    size_t headPosition() const { return head.load(std::memory_order_acquire); }
+    
+private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        uint32_t length;
+        char data[kLogRecordSize - sizeof(std::atomic<size_t>) - sizeof(uint32_t)];
+    };
+    
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> tail; // next slot producers claim
+    alignas(64) std::atomic<size_t> head; // next slot the consumer reads
+};
+
+#endif // LOG_RING_H
@@ -1,33 +1,162 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include "log_fmt.h"
 #include <string>
+#include <string_view>
 #include <mutex>
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+class LogRing;
+struct LogRecordView;
+class SharedLogRing;
+class BinaryLogEncoder;
+class MappedLogFile;
+
+enum class LogFormat {
+    Text,   // one human-readable line per record
+    Binary  // compact records, see log_format.h and labwork-logdump
+};
+
+// What an async logger does when the ring is full
+enum class LogOverflowPolicy {
+    Block,  // wait for the writer thread to make room
+    Drop,   // discard the record
+    Count   // discard it and log "Dropped N log records" once there is room
+};
+
+struct LogOptions {
+    LogFormat format = LogFormat::Text;
+    bool async = false;
+    size_t ringCapacity = 4096;      // records
+    size_t flushBatchRecords = 256;  // wake the writer once this many are queued
+    int flushIntervalMs = 50;        // longest a record waits in the ring
+    LogOverflowPolicy overflow = LogOverflowPolicy::Block;
+    
+    // Append to the cross-process ring in shared memory instead; one
+    // process holding the drainer lease writes it to the file. Takes
+    // precedence over `async`.
+    bool shared = false;
+    bool drainShared = true;         // may take the drainer lease
+    
+    // Write through a preallocated shared mapping that rotates to
+    // filename.1 .. filename.N instead of appending with stdio
+    bool mapped = false;
+    size_t segmentBytes = 64 << 20;
+    int rotateAgeSec = 0;            // 0: rotate on size only
+    int keepFiles = 10;
+};
+
+struct LogStats {
+    uint64_t enqueued;
+    uint64_t dropped;
+    uint64_t batches;          // write/writev calls made by the writer thread
+    uint64_t enqueueNsTotal;
+    uint64_t enqueueNsMax;
+};
+
+// Longest line logf() writes, newline included
+const size_t kMaxLogLine = 512;
 
 class Logger {
 public:
     static Logger& getInstance();
     
-    bool initialize(const std::string& filename);
+    bool initialize(const std::string& filename, const LogOptions& options = LogOptions());
     void log(const std::string& message);
-    void logWithTime(const std::string& prefix, int counterValue = -1);
+    void logWithTime(std::string_view prefix, int counterValue = -1);
+    
+    // A timestamped line like logWithTime, with each "{}" in the LOG_FMT
+    // format replaced by the next argument. Formats into a per-thread
+    // buffer without allocating; lines over kMaxLogLine bytes are cut short.
+    template <typename Format, typename... Args>
+    void logf(Format, const Args&... args) {
+        constexpr int placeholders = countLogPlaceholders(Format::value());
+        static_assert(placeholders >= 0, "unmatched brace in log format");
+        static_assert(placeholders == sizeof...(Args), "log format and arguments differ in count");
+        // The extra element keeps the array non-empty without arguments
+        const LogArg packed[] = {makeLogArg(args)..., LogArg()};
+        logFormatted(Format::value(), packed, sizeof...(Args));
+    }
     std::string getCurrentTime(bool withMilliseconds = false);
     
-    void close();
+    // Writes "YYYY-MM-DD HH:MM:SS[.mmm]" into buffer without allocating and
+    // returns its length (0 if it does not fit). The date/time part is cached
+    // per thread and only re-rendered when the second changes.
+    static size_t formatCurrentTime(char* buffer, size_t size, bool withMilliseconds = true);
     
+    // Blocks until every record logged before the call is written out
+    void flush();
+    LogStats getStats() const;
+    
+    void close();
+
 private:
     Logger();
     ~Logger();
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
     
+    void logFormatted(std::string_view format, const LogArg* args, size_t count);
+    void emit(const char* data, size_t length);
+    void enqueue(const char* data, size_t length);
+    bool pushRecord(const char* data, size_t length);
+    void reportDrops();
+    static int64_t currentTimeUs();
+    void wakeWriter();
+    void writerLoop();
+    size_t drainRing();
+    void drainerLoop();
+    size_t drainSharedRing();
+    void writeBatch(const LogRecordView* views, size_t count);
+    
     FILE* logFile;
+    std::unique_ptr<MappedLogFile> mappedFile;
     std::mutex logMutex;
     std::string filename;
     pid_t processId; // Unix
 #ifdef _WIN32
     DWORD winProcessId;
 #endif
+    
+    LogOptions options;
+    
+    // Binary format; binaryMutex keeps encoding and emitting in one order
+    // so time deltas chain correctly
+    std::unique_ptr<BinaryLogEncoder> encoder;
+    std::mutex binaryMutex;
+    
+    // Async mode
+    std::unique_ptr<LogRing> ring;
+    std::thread writerThread;
+    std::atomic<bool> writerRunning;
+    std::atomic<bool> writerWakePending;
+    std::mutex writerMutex;
+    std::condition_variable writerCv;
+    std::condition_variable flushedCv;
+    std::atomic<uint64_t> pendingDropReport;
+    
+    // Shared mode
+    std::unique_ptr<SharedLogRing> sharedRing;
+    std::thread drainerThread;
+    std::atomic<bool> drainerRunning;
+    
+    std::atomic<uint64_t> statEnqueued;
+    std::atomic<uint64_t> statDropped;
+    std::atomic<uint64_t> statBatches;
+    std::atomic<uint64_t> statEnqueueNsTotal;
+    std::atomic<uint64_t> statEnqueueNsMax;
 };
 
 #endif // LOGGER_H
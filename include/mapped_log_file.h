@@ -0,0 +1,95 @@
+#ifndef MAPPED_LOG_FILE_H
+#define MAPPED_LOG_FILE_H
+
+#include "log_ring.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <shared_mutex>
+
+struct MappedLogOptions {
+    size_t segmentBytes = 64 << 20;  // preallocated size of each segment
+    int maxAgeSec = 0;               // also rotate segments older than this (0: never)
+    int keepFiles = 10;              // rotated segments kept as path.1 .. path.N
+};
+
+// Append-only log file written through a shared mapping. The segment is
+// preallocated, so appending is a CAS on a cross-process write
+// position plus a memcpy. Full segments rotate to path.1, path.2, ...
+//
+// The write position lives in a small shared memory control block and
+// packs the segment generation with the offset, so one CAS hands out a
+// (generation, offset) pair and never reserves in a rotated segment. The writer whose reservation crosses the end
+// of the segment (or that seals it for age) rotates it. Writers that land
+// past the end wait for the next generation. The rotator truncates the old
+// segment to the bytes actually reserved, which leaves writers still
+// copying into it unaffected.
+class MappedLogFile {
+public:
+    MappedLogFile();
+    ~MappedLogFile();
+    
+    // Fails if every user slot of the control block is taken, since an
+    // unregistered writer is not protected from the last one's trim
+    bool open(const std::string& path, const MappedLogOptions& options);
+    void close();
+    
+    // Appends the records contiguously; returns false if they were dropped
+    bool append(const char* data, size_t length);
+    bool append(const LogRecordView* views, size_t count);
+    
+    uint64_t rotations() const { return rotationCount.load(); }
+    
+private:
+    struct Control {
+        uint32_t magic;
+        uint32_t reserved;
+        uint64_t segmentBytes;
+        std::atomic<uint64_t> position;     // generation << kOffsetBits | offset
+        std::atomic<uint64_t> inode;        // inode of the current segment
+        std::atomic<int64_t> segmentStart;  // seconds since the epoch
+        std::atomic<uint64_t> rotationClaim; // generation whose rotation is claimed, + 1
+        std::atomic<int> attachLock;        // pid serializing attach and detach
+        std::atomic<int> users[64];         // pids of attached processes
+    };
+    
+    enum class AttachResult {
+        Attached,
+        Stale,  // control block left behind, worth recreating
+        Failed
+    };
+    
+    AttachResult attach(bool creator);
+    void lockAttach();
+    void unlockAttach();
+    // False if adding and every user slot is taken
+    bool registerUser(bool add);
+    bool remapLocked(bool attaching = false);
+    bool remap(uint64_t staleGeneration);
+    // The next segment is created as path.new, leaving the current one
+    // untouched if that fails; installSegment() then moves it into place
+    bool createSegment(int& fd, uint64_t& inode);
+    void installSegment();
+    void rotate(uint64_t generation, uint64_t usedBytes);
+    void shiftOldSegments();
+    bool waitForGeneration(uint64_t generation);
+    bool tryAppend(const LogRecordView* views, size_t count, size_t total, bool& done);
+    void unmapSegment();
+    
+    std::string path;
+    std::string controlName;
+    MappedLogOptions options;
+    Control* control;
+    
+    // This process's view of the current segment. Appending threads hold
+    // mapMutex shared; remapping takes it exclusively.
+    std::shared_mutex mapMutex;
+    int fd;
+    char* base;
+    uint64_t mappedGeneration;
+    
+    std::atomic<uint64_t> rotationCount;
+};
+
+#endif // MAPPED_LOG_FILE_H
@@ -0,0 +1,67 @@
+#ifndef MASTER_ELECTION_H
+#define MASTER_ELECTION_H
+
+#include "shared_segment.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// The lease every labwork instance competes for. An all-zero segment is a
+// free lease, so whoever creates it has nothing to initialize.
+struct MasterLease {
+    std::atomic<uint64_t> holder;     // pid << 32 | term; pid 0 while free
+    std::atomic<int64_t> heartbeatMs; // steady clock, which is system-wide
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "MasterLease needs lock-free atomics to share them between processes");
+
+// Picks one master among the labwork instances on this machine. The master
+// holds a lease in shared memory and renews its heartbeat on every poll().
+// A slave takes the lease over with a CAS once the holder has exited or its
+// heartbeat is older than the lease timeout, so a crashed master is
+// replaced on the next poll and a hung one within the failover timeout.
+// Every takeover bumps the term, which is how a master that was only
+// stalled finds out it has been replaced.
+class MasterElection {
+public:
+    static MasterElection& getInstance();
+    
+    // Upper bound on how long the instances can go without a master after
+    // the master hangs. poll() must then run every pollInterval().
+    void setFailoverTimeout(std::chrono::milliseconds timeout);
+    std::chrono::milliseconds pollInterval() const;
+    
+    // Renews our lease, or takes over a free or expired one while we are
+    // campaigning. Returns true if this process is the master.
+    bool poll();
+    bool isMaster() const { return master; }
+    
+    // Gives the lease up and stops campaigning, so another instance can
+    // take over
+    void resign();
+    // Campaigns again and tries to take the lease right away
+    bool campaign();
+    
+    // PID of the current lease holder, 0 if there is none
+    long currentMaster() const;
+    
+private:
+    MasterElection();
+    ~MasterElection();
+    MasterElection(const MasterElection&) = delete;
+    MasterElection& operator=(const MasterElection&) = delete;
+    
+    static int64_t nowMs();
+    
+    SharedSegment segment;
+    MasterLease* lease;
+    MasterLease localFallback;
+    uint32_t selfPid;
+    uint64_t heldLease; // our holder word while we are master
+    bool master;
+    bool campaigning;
+    std::chrono::milliseconds failoverTimeout;
+};
+
+#endif // MASTER_ELECTION_H
@@ -4,6 +4,10 @@
 #include <vector>
 #include <string>
 #include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -12,23 +16,63 @@
 #include <unistd.h>
 #endif
 
-struct ChildProcess {
-#ifdef _WIN32
-    HANDLE handle;
-    DWORD pid;
-#else
-    pid_t pid;
-#endif
-    int type; // 1 or 2
-    time_t startTime;
-    bool finished;
+#include "child_table.h"
+#include "latency_histogram.h"
+#include <chrono>
+#include <deque>
+
+struct rusage;
+
+// How POSIX children are started. Windows always uses CreateProcess.
+enum class LaunchMethod {
+    Fork,  // fork() + execv(): copies the parent's page tables first
+    Spawn  // posix_spawn(): child borrows the parent's memory until exec
+};
+
+// Where child jobs run
+enum class ChildMode {
+    Process, // a new process per job, or a worker pool process
+    Thread   // steps on an in-process executor thread
 };
 
+// Jobs handed out so far, whichever way they run
+struct JobStats {
+    uint64_t launched;
+    uint64_t completed; // including failed
+    uint64_t failed;    // non-zero exit, killed, or lost with a crashed worker
+};
+
+// Snapshot of the pending-job queue
+struct JobQueueStats {
+    size_t queued;
+    size_t running;
+    uint64_t rejected;         // submitJob() calls refused because the queue (or the
+                               // worker pool's) was full
+    double completedPerSecond; // since the previous snapshot
+    uint64_t waitP50Us;        // time from submitJob() to launch
+    uint64_t waitP99Us;
+    uint64_t waitMaxUs;
+};
+
+class WorkerPool;
+class Scheduler;
+
 class ProcessManager {
 public:
     static ProcessManager& getInstance();
     
+    // Starts a job right away, regardless of the concurrency limits
     bool launchChildProcess(int type);
+    
+    // Queues a job. It starts as soon as fewer than its type's limit are
+    // running: immediately, or when a running job of that type completes.
+    // Returns false when the queue is full, so callers see backpressure.
+    // With a worker pool, jobs go straight to the pool's queue.
+    bool submitJob(int type);
+    void setMaxConcurrency(int type, int limit);
+    void setMaxQueuedJobs(size_t limit);
+    JobQueueStats getJobQueueStats();
+    
     void checkFinishedProcesses();
     bool hasActiveChildren();
     void cleanup();
@@ -36,17 +80,87 @@ public:
     void setMasterMode(bool isMaster);
     bool isMaster() const;
     
+    // Extra arguments passed to every child after "--child N"
+    void setChildArguments(const std::vector<std::string>& args);
+    
+    void setLaunchMethod(LaunchMethod method);
+    LaunchMethod getLaunchMethod() const;
+    
+    // Thread mode runs jobs on one executor thread. Waits inside a job
+    // are timer continuations, so a sleeping job does not hold the thread.
+    void setChildMode(ChildMode mode);
+    ChildMode getChildMode() const;
+    
+    // Runs later jobs on `workers` long-lived processes instead of one new
+    // process per job. Crashed workers are replaced by checkFinishedProcesses().
+    bool startWorkerPool(int workers);
+    // Kills the workers, busy ones included; later jobs get a process each
+    void stopWorkerPool();
+    
+    JobStats getJobStats();
+    
+#ifndef _WIN32
+    // Starts path with args (args[0] included) and returns the child pid,
+    // or -1 on failure. Does not wait for the child.
+    static pid_t startProcess(const std::string& path, const std::vector<std::string>& args,
+                              LaunchMethod method);
+#endif
+    
 private:
     ProcessManager();
     ~ProcessManager();
     ProcessManager(const ProcessManager&) = delete;
     ProcessManager& operator=(const ProcessManager&) = delete;
     
-    std::vector<ChildProcess> children;
-    std::mutex childrenMutex;
+    ChildTable children;
+    std::mutex childrenMutex; // serializes changes to children; counts are lock-free
     std::atomic<bool> isMasterProcess;
+    std::vector<std::string> childArgs;
+    std::atomic<LaunchMethod> launchMethod;
+    std::string exePath; // resolved once; empty if that failed
+    std::unique_ptr<WorkerPool> pool;
+    JobStats jobStats;
+    
+    std::atomic<ChildMode> childMode;
+    // Runs thread-mode jobs and reaps child processes as they exit
+    std::unique_ptr<Scheduler> eventLoop;
+    std::thread loopThread;
+    std::atomic<bool> loopRunning;
+    std::atomic<int> threadJobsActive;
+    std::atomic<uint64_t> threadJobsCompleted;
+    int signalFd; // SIGCHLD signalfd when pidfds are unavailable
+    
+    // Jobs waiting for a free slot of their type
+    struct PendingJob {
+        int type;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+    std::deque<PendingJob> pendingJobs;
+    size_t maxQueuedJobs;
+    int maxConcurrency[kMaxChildTypes];
+    int runningJobs[kMaxChildTypes];
+    uint64_t rejectedJobs;
+    LatencyHistogram queueWait;
+    uint64_t completedAtSnapshot;
+    std::chrono::steady_clock::time_point snapshotTime;
+    
+    bool launchLocked(int type);
+    void jobFinishedLocked(int type);
+    void dispatchLocked();
+    void stopPoolLocked();
+    uint64_t completedJobsLocked();
+    void startEventLoop();
+    void stopEventLoop();
+    void runThreadJobStep(int type, int step);
+#ifndef _WIN32
+    void finishChild(size_t slot, int status, const struct rusage& usage);
+#endif
+#ifdef __linux__
+    void reapChild(pid_t pid);
+    void watchChildSignals();
+#endif
     
-    std::string getExecutablePath();
+    static std::string getExecutablePath();
 };
 
 #endif // PROCESS_MANAGER_H
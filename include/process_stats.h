@@ -0,0 +1,114 @@
+#ifndef PROCESS_STATS_H
+#define PROCESS_STATS_H
+
+#include "latency_histogram.h"
+#include "shared_segment.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+const uint32_t kStatsMagic = 0x4c535431; // "LST1"
+const uint32_t kStatsVersion = 2;
+const int kMaxStatsSlots = 128;
+
+enum class StatsRole : uint32_t {
+    Other,
+    Master,
+    Slave,
+    Child,
+    Worker
+};
+
+// What one process publishes. Only the owner writes, with relaxed atomic
+// adds; readers only load, so reading never slows a writer down.
+struct ProcessStatsSlot {
+    std::atomic<uint32_t> pid; // 0: free
+    std::atomic<uint32_t> role;
+    std::atomic<uint64_t> ticksMissed; // skipped or caught up, see MissedTicks
+    std::atomic<uint64_t> logRecords;
+    std::atomic<uint64_t> logBytes;
+    std::atomic<uint64_t> childrenLaunched; // per-job child processes
+    std::atomic<uint64_t> childrenReaped;
+    std::atomic<uint64_t> childrenFailed;
+    LatencyHistogram tickLatenessNs;  // its count is the ticks fired
+    LatencyHistogram logWriteNs;      // per record, or per batch when async
+    LatencyHistogram childLifetimeNs; // launch to reap
+};
+
+// Start of the stats segment. Slot 0 holds what exited processes published:
+// a process adds its slot to it on the way out, or whoever reuses the slot
+// of a process that crashed does, so totals never go backwards. Readers
+// retry when a retirement overlaps them, which would otherwise count the
+// retiring slot twice or not at all.
+struct StatsSegmentHeader {
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t slotCount;
+    std::atomic<uint32_t> retiring;    // retirements in progress
+    std::atomic<uint64_t> retirements; // finished
+    ProcessStatsSlot slots[kMaxStatsSlots + 1];
+};
+
+// This process's slot in the /labwork_stats segment. It is claimed on first
+// use and handed back when the process exits. Without the segment, or with
+// every slot taken, stats go to a private slot nobody reads.
+class ProcessStats {
+public:
+    static ProcessStats& getInstance();
+    
+    ProcessStatsSlot& slot() { return *current.load(std::memory_order_relaxed); }
+    void setRole(StatsRole role);
+
+private:
+    ProcessStats();
+    ~ProcessStats();
+    ProcessStats(const ProcessStats&) = delete;
+    ProcessStats& operator=(const ProcessStats&) = delete;
+    
+    void release();
+    
+    SharedSegment segment;
+    StatsSegmentHeader* header;
+    ProcessStatsSlot localSlot;
+    std::atomic<ProcessStatsSlot*> current;
+};
+
+// Totals over a set of slots
+struct StatsSummary {
+    uint64_t processes; // still running
+    uint64_t ticksMissed;
+    uint64_t logRecords;
+    uint64_t logBytes;
+    uint64_t childrenLaunched;
+    uint64_t childrenReaped;
+    uint64_t childrenFailed;
+    LatencyHistogram tickLatenessNs;
+    LatencyHistogram logWriteNs;
+    LatencyHistogram childLifetimeNs;
+    
+    StatsSummary();
+    void clear();
+    void add(const ProcessStatsSlot& slot);
+};
+
+// Read-only view of the stats segment for `labwork --stats`
+class StatsReader {
+public:
+    bool open();
+    
+    // One line per live or not yet retired process, then the totals
+    // including exited processes
+    void printTable(FILE* out) const;
+    // Totals in the Prometheus text exposition format. Written to a
+    // temporary file and renamed, so scrapers never see half a file.
+    bool writePrometheus(const std::string& path) const;
+
+private:
+    void summarize(StatsSummary& total) const;
+    
+    SharedSegment segment;
+    const StatsSegmentHeader* header = nullptr;
+};
+
+#endif // PROCESS_STATS_H
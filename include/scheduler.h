@@ -0,0 +1,121 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class LatencyHistogram;
+
+// What a periodic task does after falling behind by whole intervals
+enum class MissedTicks {
+    Skip,    // drop the missed runs and continue on the original grid
+    CatchUp  // run them back to back (at most kMaxCatchUp, then skip)
+};
+
+// Event loop for one thread: runs periodic tasks and file descriptor
+// callbacks, sleeping until the earliest deadline or a readable fd instead
+// of polling. Deadlines are absolute: a task's n-th run is due at
+// start + n * interval, so a late wake-up never shifts later runs.
+//
+// On Linux the thread blocks in epoll_wait on a timerfd armed for that
+// deadline, the watched fds and an eventfd for stop()/wake(). Other POSIX
+// systems use poll() with a self-pipe; Windows waits on a condition
+// variable and cannot watch fds.
+class Scheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::function<void()>;
+    
+    Scheduler();
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+    
+    static const int kMaxCatchUp = 1000;
+    
+    // Must be called before run(). The first run is one interval from now.
+    // If `lateness` is given, every run records how far past its deadline
+    // it started, in nanoseconds.
+    void addPeriodic(Clock::duration interval, Task task,
+                     MissedTicks policy = MissedTicks::Skip,
+                     LatencyHistogram* lateness = nullptr);
+    
+    // Runs task once from run(), `delay` from now. Unlike addPeriodic() this
+    // may be called from any thread, including while run() is sleeping.
+    void post(Task task, Clock::duration delay = Clock::duration::zero());
+    
+    // Calls onReadable from run() whenever fd has data (or hit EOF).
+    // Returns false if the fd cannot be watched, e.g. a regular file.
+    bool watchFd(int fd, Task onReadable);
+    void unwatchFd(int fd);
+    
+    // Runs due tasks and fd callbacks until `running` turns false or stop()
+    // is called. With nothing scheduled it sleeps until stop() or wake().
+    void run(const std::atomic<bool>& running);
+    
+    // Wakes run() and makes it return. Async-signal-safe on POSIX.
+    void stop();
+    
+    // Wakes run() and calls the wake handler from it. Async-signal-safe on
+    // POSIX, so signal handlers can hand work to the loop.
+    void wake();
+    void setWakeHandler(Task handler);
+    
+    uint64_t wakeups() const { return wakeupCount.load(); }
+    uint64_t missedTicks() const { return missedCount.load(); }
+    
+private:
+    struct Entry {
+        Clock::time_point deadline;
+        Clock::duration interval; // zero for one-shot tasks
+        size_t task;
+        MissedTicks policy;
+        LatencyHistogram* lateness;
+        int behind; // consecutive catch-up runs
+    };
+    
+    struct Watch {
+        int fd;
+        Task onReadable;
+    };
+    
+    static bool later(const Entry& a, const Entry& b) { return a.deadline > b.deadline; }
+    
+    // Sleeps until the deadline (forever if there is none) and returns the
+    // watched fds that became readable
+    void wait(const Clock::time_point* deadline, std::vector<int>& readyFds);
+    void signalWake();
+    void takePosted();
+    
+    std::vector<Task> tasks;
+    std::vector<size_t> freeTasks; // slots of finished one-shot tasks
+    std::mutex postMutex;
+    std::vector<std::pair<Clock::time_point, Task>> posted;
+    std::vector<Entry> heap; // min-heap on deadline
+    std::vector<Watch> watches;
+    Task wakeHandler;
+    std::atomic<bool> stopped;
+    std::atomic<bool> wakeRequested;
+    std::atomic<uint64_t> wakeupCount;
+    std::atomic<uint64_t> missedCount;
+    Clock::duration shortestInterval;
+    
+#if defined(__linux__)
+    int epollFd;
+    int timerFd;
+    int wakeFd;
+#elif !defined(_WIN32)
+    int wakePipe[2];
+#else
+    std::mutex waitMutex;
+    std::condition_variable waitCv;
+#endif
+};
+
+#endif // SCHEDULER_H
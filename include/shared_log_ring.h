@@ -0,0 +1,79 @@
+#ifndef SHARED_LOG_RING_H
+#define SHARED_LOG_RING_H
+
+#include "log_ring.h"
+#include "shared_segment.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+const uint32_t kSharedLogMagic = 0x4c414231; // "LAB1"
+const uint32_t kSharedLogCapacity = 4096;    // records, power of two
+
+// Log ring living in a POSIX shared memory segment. Any labwork process can
+// append without syscalls; one process at a time holds the drainer lease
+// and copies records to the log file. A record's slot position is taken
+// from the segment-wide tail, so it doubles as a global sequence number and
+// draining in position order gives one totally ordered log.
+class SharedLogRing {
+public:
+    SharedLogRing();
+    ~SharedLogRing();
+    
+    bool open(const char* name);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+    
+    // Producer side. Returns false if the ring is full, or if the drainer
+    // skipped the claimed slot because this writer stalled before it
+    // started copying.
+    bool tryPush(const char* data, size_t length);
+    
+    // Drainer side, only valid while holding the lease. A slot that was
+    // claimed but not started on within stallMs (its writer died or
+    // stalled in between) is skipped so it cannot wedge the log; a stalled
+    // writer that resumes later finds its record dropped. A slot a writer
+    // has started copying into is never skipped, since it could be reused
+    // under the writer.
+    size_t peek(LogRecordView* out, size_t max, int stallMs);
+    void release(size_t count);
+    uint64_t skippedRecords() const;
+    
+    // Drainer lease: taken when free or when the holder no longer exists
+    bool tryAcquireDrainer();
+    bool isDrainer() const;
+    void releaseDrainer();
+    
+    uint64_t headPosition() const;
+    uint64_t tailPosition() const;
+    
+private:
+    struct Header {
+        std::atomic<uint32_t> magic;
+        uint32_t capacity;
+        std::atomic<int> drainerPid;
+        std::atomic<uint64_t> skipped;
+        alignas(64) std::atomic<uint64_t> tail;
+        alignas(64) std::atomic<uint64_t> head;
+    };
+    
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        uint32_t length;
+        char data[kLogRecordSize - sizeof(std::atomic<uint64_t>) - sizeof(uint32_t)];
+    };
+    
+    static size_t segmentSize();
+    
+    SharedSegment segment;
+    Header* header;
+    Slot* slots;
+    uint64_t mask;
+    int pid;
+    
+    // Drainer-local stall tracking
+    uint64_t stalledPosition;
+    int64_t stalledSinceMs;
+};
+
+#endif // SHARED_LOG_RING_H
@@ -0,0 +1,45 @@
+#ifndef SHARED_SEGMENT_H
+#define SHARED_SEGMENT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// A named shared memory segment that lives until it is removed by hand,
+// for state that outlives any one labwork process. Exactly one process
+// creates it; fresh pages are zero.
+class SharedSegment {
+public:
+    SharedSegment();
+    ~SharedSegment();
+    SharedSegment(const SharedSegment&) = delete;
+    SharedSegment& operator=(const SharedSegment&) = delete;
+    
+    // name is a POSIX shm name such as "/labwork_stats". Creates the
+    // segment unless readOnly. If another process is creating it, waits
+    // until it is sized. created() then tells whether this call created it.
+    bool open(const char* name, size_t size, bool readOnly);
+    void close();
+    
+    void* data() const { return memory; }
+    bool created() const { return createdSegment; }
+    
+    // For a segment that starts with a magic word: the creator publishes it
+    // once the rest of the header is filled in, everyone else waits for it.
+    // Returns false if it does not show up in time.
+    static bool waitForMagic(const std::atomic<uint32_t>& magic, uint32_t expected);
+    
+private:
+    void* memory;
+    size_t mappedSize;
+    bool createdSegment;
+#ifdef _WIN32
+    void* mapHandle;
+#endif
+};
+
+// False once pid has exited. PIDs that exist but belong to another user
+// count as alive.
+bool processExists(uint32_t pid);
+
+#endif // SHARED_SEGMENT_H
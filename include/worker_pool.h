@@ -0,0 +1,93 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "process_manager.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+const uint32_t kWorkerPoolMagic = 0x4c504c31; // "LPL1"
+const uint32_t kJobQueueCapacity = 4096;      // jobs, power of two
+const int kMaxPoolWorkers = 64;
+
+// Long-lived worker processes fed through a job queue in a POSIX shared
+// memory segment. Jobs go through a bounded MPMC ring. Idle workers sleep
+// on a futex that a submit only wakes when somebody is actually waiting.
+// Workers count completions in the segment; the master respawns workers
+// that die and counts their in-flight job as failed, including one taken
+// off the queue but not yet started.
+class WorkerPool {
+public:
+    using JobHandler = std::function<void(int type)>;
+    
+    WorkerPool();
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    
+    // Master side. Each worker runs `command... <segment name> <slot>`.
+    bool start(int workers, const std::vector<std::string>& command, LaunchMethod method);
+    void stop();
+    bool isRunning() const { return header != nullptr; }
+    
+    bool submit(int type); // false if the queue is full
+    uint64_t submitted() const { return submittedJobs.load(); }
+    uint64_t completed() const; // finished or failed
+    uint64_t failed() const;
+    
+    // Reaps workers that died and starts replacements; returns how many died
+    int superviseWorkers();
+    
+    // Waits until at least `count` jobs have completed. Returns false on timeout.
+    bool waitForCompleted(uint64_t count, int timeoutMs);
+    
+    // Worker side: runs jobs until the pool stops or the master goes away.
+    // Returns the process exit status.
+    static int serve(const char* name, int slot, const JobHandler& handler);
+    
+private:
+    struct alignas(64) WorkerSlot {
+        std::atomic<int32_t> pid;
+        std::atomic<int32_t> jobType; // 0 while idle
+        std::atomic<uint64_t> jobsDone;
+        std::atomic<uint64_t> taking; // queue position + 1 being popped, 0 if none
+    };
+    
+    struct Header {
+        uint32_t magic;
+        uint32_t capacity;
+        int32_t masterPid;
+        std::atomic<uint32_t> stopping;
+        alignas(64) std::atomic<uint64_t> tail;
+        std::atomic<uint32_t> jobSignal; // futex word, bumped on every submit
+        std::atomic<uint32_t> idleWorkers;
+        alignas(64) std::atomic<uint64_t> head;
+        alignas(64) std::atomic<uint64_t> completedJobs;
+        std::atomic<uint64_t> failedJobs;
+        std::atomic<uint32_t> completedSignal; // futex word
+        std::atomic<uint32_t> completionWaiters;
+        WorkerSlot workers[kMaxPoolWorkers];
+    };
+    
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        int32_t type;
+    };
+    
+    static size_t segmentSize();
+    static bool tryPop(Header* header, Slot* slots, int worker, int& type);
+    bool spawnWorker(int slot);
+    void reclaimJob(int slot);
+    
+    Header* header;
+    Slot* slots;
+    std::string name;
+    std::vector<std::string> command;
+    LaunchMethod launchMethod;
+    int workerCount;
+    std::atomic<uint64_t> submittedJobs;
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,43 @@
+#include "child_job.h"
+#include "counter.h"
+#include "logger.h"
+#include <thread>
+
+std::chrono::milliseconds runChildJobStep(int type, int step) {
+    Logger& logger = Logger::getInstance();
+    Counter& counter = Counter::getInstance();
+    const std::chrono::milliseconds done(-1);
+    
+    if (step == 0) {
+        logger.logf(LOG_FMT("Child {} started"), type);
+    }
+    
+    // Atomic read-modify-write, so concurrent increments are never clobbered
+    if (type == 1) {
+        // Type 1: increase by 10
+        counter.fetchAdd(10);
+        logger.logWithTime("Child 1 increased counter by 10");
+    } else if (type == 2) {
+        // Type 2: multiply by 2, wait 2 seconds, divide by 2
+        if (step == 0) {
+            counter.fetchMul(2);
+            logger.logWithTime("Child 2 multiplied counter by 2");
+            return std::chrono::seconds(2);
+        }
+        counter.fetchDiv(2);
+        logger.logWithTime("Child 2 divided counter by 2");
+    }
+    
+    logger.logf(LOG_FMT("Child {} finished"), type);
+    return done;
+}
+
+void runChildJob(int type) {
+    for (int step = 0;; step++) {
+        std::chrono::milliseconds wait = runChildJobStep(type, step);
+        if (wait.count() < 0) {
+            break;
+        }
+        std::this_thread::sleep_for(wait);
+    }
+}
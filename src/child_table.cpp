@@ -0,0 +1,66 @@
+#include "child_table.h"
+
+ChildTable::ChildTable() : freeHead(kNoSlot), activeCount(0) {
+    for (auto& count : activeByType) {
+        count.store(0);
+    }
+}
+
+size_t ChildTable::insert(const ChildProcess& child) {
+    size_t slot;
+    if (freeHead != kNoSlot) {
+        slot = freeHead;
+        freeHead = slots[slot].nextFree;
+        slots[slot].child = child;
+        slots[slot].live = true;
+    } else {
+        slots.push_back(Slot{child, true, kNoSlot});
+        slot = slots.size() - 1;
+    }
+    
+    slotByPid[child.pid] = slot;
+    if (child.type >= 0 && child.type < kMaxChildTypes) {
+        activeByType[child.type].fetch_add(1, std::memory_order_release);
+    }
+    activeCount.fetch_add(1, std::memory_order_release);
+    return slot;
+}
+
+void ChildTable::remove(size_t slot) {
+    if (slot >= slots.size() || !slots[slot].live) {
+        return;
+    }
+    
+    Slot& entry = slots[slot];
+    slotByPid.erase(entry.child.pid);
+    if (entry.child.type >= 0 && entry.child.type < kMaxChildTypes) {
+        activeByType[entry.child.type].fetch_sub(1, std::memory_order_release);
+    }
+    activeCount.fetch_sub(1, std::memory_order_release);
+    
+    entry.live = false;
+    entry.nextFree = freeHead;
+    freeHead = slot;
+}
+
+void ChildTable::clear() {
+    slots.clear();
+    slotByPid.clear();
+    freeHead = kNoSlot;
+    activeCount.store(0);
+    for (auto& count : activeByType) {
+        count.store(0);
+    }
+}
+
+size_t ChildTable::find(ProcessId pid) const {
+    auto it = slotByPid.find(pid);
+    return it == slotByPid.end() ? kNoSlot : it->second;
+}
+
+size_t ChildTable::activeOfType(int type) const {
+    if (type < 0 || type >= kMaxChildTypes) {
+        return 0;
+    }
+    return activeByType[type].load(std::memory_order_acquire);
+}
@@ -1,107 +1,246 @@
 #include "counter.h"
-#include <iostream>
-#include <cstring>
+#include "counter_registry.h"
+#include "futex.h"
+#include <chrono>
+#include <climits>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace {
+
+// Two's complement wrap-around, so aggregates stay exact even when a single
+// shard overflows
+int wrapAdd(int a, int b) {
+    return static_cast<int>(static_cast<unsigned>(a) + static_cast<unsigned>(b));
+}
+
+int wrapSub(int a, int b) {
+    return static_cast<int>(static_cast<unsigned>(a) - static_cast<unsigned>(b));
+}
+
+int currentCpu() {
+#ifdef _WIN32
+    return static_cast<int>(GetCurrentProcessorNumber());
+#elif defined(__linux__)
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu;
+#else
+    return 0;
+#endif
+}
+
+#ifndef _WIN32
+// Forked processes inherit the parent's shard; give them their own
+void pickShardAfterFork() {
+    Counter::getInstance().resetProcessShard();
+}
+#endif
+
+} // namespace
+
 Counter& Counter::getInstance() {
     static Counter instance;
     return instance;
 }
 
-Counter::Counter() : value(0) {
-#ifdef _WIN32
-    // Windows shared memory
-    sharedMemory = nullptr;
-    mapHandle = CreateFileMapping(
-        INVALID_HANDLE_VALUE,
-        NULL,
-        PAGE_READWRITE,
-        0,
-        sizeof(int),
-        L"Global\\CounterSharedMemory"
-    );
-    
-    if (mapHandle == NULL) {
-        std::cerr << "Failed to create file mapping: " << GetLastError() << std::endl;
-        return;
+Counter::Counter()
+    : shared(&localFallback), mode(CounterMode::Single), processShard(0) {
+    localFallback.value.store(0);
+    localFallback.shardsActive.store(0);
+    localFallback.generation.store(0);
+    localFallback.waiters.store(0);
+    for (auto& shard : localFallback.shards) {
+        shard.value.store(0);
     }
     
-    sharedMemory = MapViewOfFile(mapHandle, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(int));
-    if (sharedMemory == NULL) {
-        std::cerr << "Failed to map view of file: " << GetLastError() << std::endl;
-        CloseHandle(mapHandle);
-        return;
-    }
+    resetProcessShard();
+#ifndef _WIN32
+    pthread_atfork(nullptr, nullptr, pickShardAfterFork);
+#endif
     
-    // Initialize if first process
-    int* sharedValue = static_cast<int*>(sharedMemory);
-    *sharedValue = 0;
+    // The registry initializes the segment only when it creates it, so
+    // starting another process no longer resets the value
+    CounterShared* registered = CounterRegistry::getInstance().defaultCounter();
+    if (registered) {
+        shared = registered;
+    }
+}
+
+void Counter::resetProcessShard() {
+#ifdef _WIN32
+    processShard = static_cast<int>(GetCurrentProcessId() % kCounterShards);
 #else
-    // POSIX shared memory
-    shm_fd = shm_open("/counter_shm", O_CREAT | O_RDWR, 0666);
-    if (shm_fd == -1) {
-        perror("shm_open");
-        return;
+    processShard = static_cast<int>(getpid() % kCounterShards);
+#endif
+}
+
+void Counter::setMode(CounterMode newMode) {
+    if (newMode != CounterMode::Single) {
+        shared->shardsActive.store(1);
     }
-    
-    if (ftruncate(shm_fd, sizeof(int)) == -1) {
-        perror("ftruncate");
-        return;
+    mode = newMode;
+}
+
+CounterMode Counter::getMode() const {
+    return mode;
+}
+
+std::atomic<int>& Counter::incrementTarget() {
+    switch (mode) {
+    case CounterMode::ShardedPerCpu:
+        return shared->shards[currentCpu() % kCounterShards].value;
+    case CounterMode::ShardedPerProcess:
+        return shared->shards[processShard].value;
+    default:
+        return shared->value;
     }
-    
-    sharedMemory = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (sharedMemory == MAP_FAILED) {
-        perror("mmap");
-        return;
+}
+
+int Counter::sumShards() {
+    int sum = 0;
+    for (auto& shard : shared->shards) {
+        sum = wrapAdd(sum, shard.value.load());
     }
-    
-    // Initialize if first process
-    int* sharedValue = static_cast<int*>(sharedMemory);
-    *sharedValue = 0;
-#endif
-    
-    // Read initial value from shared memory
-    value.store(*static_cast<int*>(sharedMemory));
+    return sum;
 }
 
 void Counter::increment() {
-    std::lock_guard<std::mutex> lock(mtx);
-    int current = value.load();
-    value.store(current + 1);
-    
-    // Update shared memory
-    if (sharedMemory) {
-        *static_cast<int*>(sharedMemory) = value.load();
+    incrementTarget().fetch_add(1);
+    notifyChange();
+}
+
+int Counter::add(int delta) {
+    int before = incrementTarget().fetch_add(delta);
+    notifyChange();
+    if (mode == CounterMode::Single && !shared->shardsActive.load()) {
+        return wrapAdd(before, delta);
     }
+    // Sharded: re-aggregate, which may already include other writers
+    return getValue();
 }
 
-void Counter::setValue(int newValue) {
-    std::lock_guard<std::mutex> lock(mtx);
-    value.store(newValue);
+int Counter::exchange(int newValue) {
+    int old;
+    if (shared->shardsActive.load()) {
+        int shards = sumShards();
+        old = wrapAdd(shared->value.exchange(wrapSub(newValue, shards)), shards);
+    } else {
+        old = shared->value.exchange(newValue);
+    }
+    notifyChange();
+    return old;
+}
+
+bool Counter::compareExchange(int& expected, int desired) {
+    int shards = shared->shardsActive.load() ? sumShards() : 0;
+    int base = wrapSub(expected, shards);
+    if (shared->value.compare_exchange_strong(base, wrapSub(desired, shards))) {
+        notifyChange();
+        return true;
+    }
+    expected = wrapAdd(base, shards);
+    return false;
+}
+
+int Counter::fetchAdd(int delta) {
+    return wrapSub(add(delta), delta);
+}
+
+int Counter::fetchMul(int factor) {
+    int expected = getValue();
+    while (!compareExchange(expected, static_cast<int>(static_cast<unsigned>(expected) *
+                                                       static_cast<unsigned>(factor)))) {
+    }
+    return expected;
+}
+
+int Counter::fetchDiv(int divisor) {
+    if (divisor == 0) {
+        return getValue();
+    }
     
-    // Update shared memory
-    if (sharedMemory) {
-        *static_cast<int*>(sharedMemory) = value.load();
+    int expected = getValue();
+    for (;;) {
+        // INT_MIN / -1 overflows; wrap like the other operations instead
+        int desired = divisor == -1 ? wrapSub(0, expected) : expected / divisor;
+        if (compareExchange(expected, desired)) {
+            return expected;
+        }
     }
-    cv.notify_all();
+}
+
+bool Counter::update(const std::function<int(int)>& fn, int& oldValue, int maxRetries) {
+    oldValue = getValue();
+    for (int attempt = 0; attempt <= maxRetries; attempt++) {
+        if (compareExchange(oldValue, fn(oldValue))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Counter::setValue(int newValue) {
+    exchange(newValue);
 }
 
 int Counter::getValue() {
-    return value.load();
+    int base = shared->value.load();
+    if (!shared->shardsActive.load()) {
+        return base;
+    }
+    return wrapAdd(base, sumShards());
+}
+
+// Called after every write. The seq_cst store of the value and this load of
+// waiters pair with the waiter's increment of waiters and reload of the
+// value, so either the waiter sees the new value or we see the waiter.
+void Counter::notifyChange() {
+    if (shared->waiters.load() > 0) {
+        shared->generation.fetch_add(1);
+        futexWake(&shared->generation, INT_MAX);
+    }
+}
+
+bool Counter::waitForChange(int oldValue, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    bool changed = false;
+    
+    shared->waiters.fetch_add(1);
+    for (;;) {
+        uint32_t generation = shared->generation.load();
+        if (getValue() != oldValue) {
+            changed = true;
+            break;
+        }
+        
+        int waitMs = -1;
+        if (timeoutMs >= 0) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) {
+                break;
+            }
+            waitMs = static_cast<int>(left);
+        }
+        futexWait(&shared->generation, generation, waitMs);
+    }
+    shared->waiters.fetch_sub(1);
+    return changed;
 }
 
 void* Counter::getSharedMemory() {
-    return sharedMemory;
+    return shared == &localFallback ? nullptr : shared;
 }
 
 size_t Counter::getSharedMemorySize() {
-    return sizeof(int);
+    return sizeof(CounterShared);
 }
@@ -0,0 +1,244 @@
+#include "counter_checkpoint.h"
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+// Serializes writers across processes; released when destroyed
+class FileLock {
+public:
+#ifdef _WIN32
+    explicit FileLock(void* handle) : handle(handle) {
+        OVERLAPPED overlapped = {};
+        LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+    }
+    ~FileLock() {
+        OVERLAPPED overlapped = {};
+        UnlockFileEx(handle, 0, 1, 0, &overlapped);
+    }
+private:
+    void* handle;
+#else
+    explicit FileLock(int fd) : fd(fd) {
+        while (flock(fd, LOCK_EX) == -1 && errno == EINTR) {
+        }
+    }
+    ~FileLock() { flock(fd, LOCK_UN); }
+private:
+    int fd;
+#endif
+};
+
+int64_t wallTimeMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+CounterCheckpoint::CounterCheckpoint() : file(nullptr) {
+#ifdef _WIN32
+    fileHandle = INVALID_HANDLE_VALUE;
+    mapHandle = NULL;
+#else
+    fd = -1;
+#endif
+}
+
+CounterCheckpoint::~CounterCheckpoint() {
+    close();
+}
+
+bool CounterCheckpoint::open(const std::string& filePath) {
+    if (file) {
+        return false;
+    }
+    path = filePath;
+    
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open " << path << ": " << GetLastError() << std::endl;
+        return false;
+    }
+    
+    // Creating the mapping extends a new file, zero-filled
+    mapHandle = CreateFileMapping(fileHandle, NULL, PAGE_READWRITE, 0,
+                                  sizeof(CheckpointFileLayout), NULL);
+    void* mem = mapHandle ? MapViewOfFile(mapHandle, FILE_MAP_ALL_ACCESS, 0, 0,
+                                          sizeof(CheckpointFileLayout)) : NULL;
+    if (mem == NULL) {
+        std::cerr << "Failed to map " << path << ": " << GetLastError() << std::endl;
+        close();
+        return false;
+    }
+    file = static_cast<CheckpointFileLayout*>(mem);
+    FileLock lock(fileHandle);
+#else
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror(path.c_str());
+        return false;
+    }
+    
+    FileLock lock(fd);
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close();
+        return false;
+    }
+    if (static_cast<size_t>(st.st_size) < sizeof(CheckpointFileLayout) &&
+        ftruncate(fd, sizeof(CheckpointFileLayout)) == -1) {
+        perror("ftruncate");
+        close();
+        return false;
+    }
+    
+    void* mem = mmap(NULL, sizeof(CheckpointFileLayout), PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        close();
+        return false;
+    }
+    file = static_cast<CheckpointFileLayout*>(mem);
+#endif
+    
+    // Only a file we just created lacks the magic. The header reaches the
+    // disk before any checkpoint can refer to it.
+    if (file->magic == 0) {
+        file->version = kCheckpointVersion;
+        file->slotCount = 2;
+        file->createdMs = wallTimeMs();
+        file->magic = kCheckpointMagic;
+#ifdef _WIN32
+        FlushViewOfFile(file, sizeof(CheckpointFileLayout));
+        FlushFileBuffers(fileHandle);
+#else
+        msync(file, sizeof(CheckpointFileLayout), MS_SYNC);
+#endif
+    } else if (file->magic != kCheckpointMagic || file->version != kCheckpointVersion ||
+               file->slotCount != 2) {
+        std::cerr << path << " is not a version " << kCheckpointVersion
+                  << " counter checkpoint file" << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CounterCheckpoint::close() {
+#ifdef _WIN32
+    if (file) {
+        UnmapViewOfFile(file);
+    }
+    if (mapHandle) {
+        CloseHandle(mapHandle);
+        mapHandle = NULL;
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (file) {
+        munmap(file, sizeof(CheckpointFileLayout));
+    }
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+    file = nullptr;
+}
+
+// FNV-1a over the slot, minus the checksum itself
+uint64_t CounterCheckpoint::checksum(const CheckpointSlot& slot) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&slot);
+    uint64_t hash = 14695981039346656037ull ^ kCheckpointMagic;
+    for (size_t i = 0; i < offsetof(CheckpointSlot, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+int CounterCheckpoint::latestSlot() const {
+    int latest = -1;
+    for (int i = 0; i < 2; i++) {
+        const CheckpointSlot& slot = file->sectors[i].slot;
+        if (slot.sequence != 0 && slot.checksum == checksum(slot) &&
+            (latest == -1 || slot.sequence > file->sectors[latest].slot.sequence)) {
+            latest = i;
+        }
+    }
+    return latest;
+}
+
+bool CounterCheckpoint::read(int64_t& value, uint64_t* sequence) const {
+    if (!file) {
+        return false;
+    }
+    
+    int latest = latestSlot();
+    if (latest == -1) {
+        return false;
+    }
+    value = file->sectors[latest].slot.value;
+    if (sequence) {
+        *sequence = file->sectors[latest].slot.sequence;
+    }
+    return true;
+}
+
+bool CounterCheckpoint::write(int64_t value) {
+    if (!file) {
+        return false;
+    }
+    
+#ifdef _WIN32
+    FileLock lock(fileHandle);
+#else
+    FileLock lock(fd);
+#endif
+    int latest = latestSlot();
+    if (latest != -1 && file->sectors[latest].slot.value == value) {
+        return true;
+    }
+    
+    // Overwrite the older (or broken) slot; the latest stays intact
+    uint64_t sequence = latest == -1 ? 1 : file->sectors[latest].slot.sequence + 1;
+    CheckpointSlot& slot = file->sectors[latest == 0 ? 1 : 0].slot;
+    slot.sequence = sequence;
+    slot.value = value;
+    slot.wallTimeMs = wallTimeMs();
+    slot.checksum = checksum(slot);
+    
+#ifdef _WIN32
+    if (!FlushViewOfFile(&slot, sizeof(slot)) || !FlushFileBuffers(fileHandle)) {
+        std::cerr << "Failed to flush " << path << ": " << GetLastError() << std::endl;
+        return false;
+    }
+#else
+    // msync wants a page-aligned start; the whole file is one page
+    if (msync(file, sizeof(CheckpointFileLayout), MS_SYNC) == -1) {
+        perror("msync");
+        return false;
+    }
+#endif
+    return true;
+}
@@ -0,0 +1,166 @@
+#include "counter_registry.h"
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+const char* kSegmentName = "/labwork_counters";
+
+int initialDefaultValue = 0;
+
+// FNV-1a
+uint32_t hashName(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const char* p = name; *p; p++) {
+        hash = (hash ^ static_cast<unsigned char>(*p)) * 16777619u;
+    }
+    return hash;
+}
+
+} // namespace
+
+CounterRegistry& CounterRegistry::getInstance() {
+    static CounterRegistry instance;
+    static bool opened = instance.open(false);
+    (void)opened;
+    return instance;
+}
+
+CounterRegistry::CounterRegistry()
+    : header(nullptr), entries(nullptr), readOnly(false), createdSegment(false) {
+}
+
+CounterRegistry::~CounterRegistry() {
+    close();
+}
+
+size_t CounterRegistry::segmentSize() {
+    return sizeof(CounterRegistryHeader) + kCounterRegistryCapacity * sizeof(CounterEntry);
+}
+
+bool CounterRegistry::open(bool readOnlyAccess) {
+    if (header) {
+        return readOnly == readOnlyAccess;
+    }
+    readOnly = readOnlyAccess;
+    
+    // Exactly one process creates the segment and initializes it; the rest
+    // attach to whatever it holds, so a new instance never resets counters
+    if (!segment.open(kSegmentName, segmentSize(), readOnly)) {
+        return false;
+    }
+    header = static_cast<CounterRegistryHeader*>(segment.data());
+    entries = reinterpret_cast<CounterEntry*>(static_cast<char*>(segment.data()) +
+                                              sizeof(CounterRegistryHeader));
+    
+    createdSegment = segment.created();
+    if (createdSegment) {
+        header->defaultCounter.value.store(initialDefaultValue);
+        header->version = kCounterRegistryVersion;
+        header->capacity = kCounterRegistryCapacity;
+        header->magic.store(kCounterRegistryMagic, std::memory_order_release);
+        return true;
+    }
+    
+    if (!SharedSegment::waitForMagic(header->magic, kCounterRegistryMagic)) {
+        std::cerr << "Counter registry " << kSegmentName << " was never initialized" << std::endl;
+        close();
+        return false;
+    }
+    if (header->version != kCounterRegistryVersion ||
+        header->capacity != kCounterRegistryCapacity) {
+        std::cerr << "Counter registry " << kSegmentName << " has version " << header->version
+                  << " and capacity " << header->capacity << ", expected "
+                  << kCounterRegistryVersion << " and " << kCounterRegistryCapacity
+                  << "; remove it once no labwork process is running" << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CounterRegistry::close() {
+    segment.close();
+    header = nullptr;
+    entries = nullptr;
+}
+
+CounterEntry* CounterRegistry::lookup(const char* name, bool create) const {
+    size_t length = strlen(name);
+    if (!header || length == 0 || length >= static_cast<size_t>(kCounterNameMax)) {
+        return nullptr;
+    }
+    
+    uint32_t hash = hashName(name);
+    uint32_t mask = kCounterRegistryCapacity - 1;
+    for (uint32_t probe = 0; probe < kCounterRegistryCapacity; probe++) {
+        CounterEntry& entry = entries[(hash + probe) & mask];
+        uint32_t state = entry.state.load(std::memory_order_acquire);
+        
+        if (state == kCounterEntryEmpty) {
+            if (!create) {
+                return nullptr;
+            }
+            if (entry.state.compare_exchange_strong(state, kCounterEntryClaimed)) {
+                entry.hash = hash;
+                memcpy(entry.name, name, length + 1);
+                entry.state.store(kCounterEntryReady, std::memory_order_release);
+                header->used.fetch_add(1);
+                return &entry;
+            }
+            // Lost the race; state now holds what the winner stored
+        }
+        
+        // Another process is writing this name, which may be ours. Give up
+        // on the entry if that takes implausibly long: its writer died.
+        for (int spins = 0; state == kCounterEntryClaimed && spins < 100000; spins++) {
+            std::this_thread::yield();
+            state = entry.state.load(std::memory_order_acquire);
+        }
+        
+        if (state == kCounterEntryReady && entry.hash == hash &&
+            strncmp(entry.name, name, kCounterNameMax) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+std::atomic<int64_t>* CounterRegistry::counter(const char* name) {
+    if (readOnly) {
+        return nullptr;
+    }
+    CounterEntry* entry = lookup(name, true);
+    return entry ? &entry->value : nullptr;
+}
+
+const std::atomic<int64_t>* CounterRegistry::find(const char* name) const {
+    CounterEntry* entry = lookup(name, false);
+    return entry ? &entry->value : nullptr;
+}
+
+void CounterRegistry::forEach(
+    const std::function<void(const char* name, int64_t value)>& f) const {
+    if (!header) {
+        return;
+    }
+    for (uint32_t i = 0; i < kCounterRegistryCapacity; i++) {
+        const CounterEntry& entry = entries[i];
+        if (entry.state.load(std::memory_order_acquire) == kCounterEntryReady) {
+            f(entry.name, entry.value.load());
+        }
+    }
+}
+
+size_t CounterRegistry::size() const {
+    return header ? header->used.load() : 0;
+}
+
+void CounterRegistry::setInitialDefaultValue(int value) {
+    initialDefaultValue = value;
+}
+
+CounterShared* CounterRegistry::defaultCounter() {
+    return header && !readOnly ? &header->defaultCounter : nullptr;
+}
@@ -0,0 +1,46 @@
+#include "futex.h"
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+bool futexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeoutMs) {
+#ifdef __linux__
+    struct timespec timeout;
+    struct timespec* timeoutPtr = nullptr;
+    if (timeoutMs >= 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        timeoutPtr = &timeout;
+    }
+    
+    // Not FUTEX_PRIVATE_FLAG: waiters and wakers may be in different processes
+    long rc = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT,
+                      expected, timeoutPtr, nullptr, 0);
+    return rc == 0 || errno != ETIMEDOUT;
+#else
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (word->load() == expected) {
+        if (timeoutMs >= 0 && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+#endif
+}
+
+void futexWake(std::atomic<uint32_t>* word, int count) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+#else
+    (void)word;
+    (void)count;
+#endif
+}
@@ -0,0 +1,120 @@
+#include "latency_histogram.h"
+
+namespace {
+
+int highestBit(uint64_t value) {
+    int bit = 0;
+    while (value >>= 1) {
+        bit++;
+    }
+    return bit;
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+int LatencyHistogram::bucketOf(uint64_t value) {
+    if (value < static_cast<uint64_t>(kSubBuckets)) {
+        return static_cast<int>(value);
+    }
+    int exponent = highestBit(value);
+    int shift = exponent - kSubBucketBits;
+    int sub = static_cast<int>((value >> shift) & (kSubBuckets - 1));
+    return kSubBuckets + shift * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int bucket) {
+    if (bucket < kSubBuckets) {
+        return static_cast<uint64_t>(bucket);
+    }
+    int shift = (bucket - kSubBuckets) / kSubBuckets;
+    uint64_t sub = static_cast<uint64_t>((bucket - kSubBuckets) % kSubBuckets);
+    uint64_t next = (kSubBuckets + sub + 1) << shift;
+    return next - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sumValue.fetch_add(value, std::memory_order_relaxed);
+    
+    uint64_t prev = maxValue.load(std::memory_order_relaxed);
+    while (value > prev &&
+           !maxValue.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+    sumValue.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const {
+    return maxValue.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::sum() const {
+    return sumValue.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::bucketCount(int bucket) const {
+    return buckets[bucket].load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    // Sum the buckets instead of trusting `total`, which a concurrent
+    // writer may have bumped before its bucket
+    uint64_t counted = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        counted += bucketCount(i);
+    }
+    if (counted == 0) {
+        return 0;
+    }
+    
+    uint64_t rank = static_cast<uint64_t>(q * counted + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > counted) {
+        rank = counted;
+    }
+    
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += bucketCount(i);
+        if (seen >= rank) {
+            uint64_t bound = bucketUpperBound(i);
+            uint64_t top = max();
+            return bound < top ? bound : top;
+        }
+    }
+    return max();
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < kBuckets; i++) {
+        uint64_t n = other.bucketCount(i);
+        if (n) {
+            buckets[i].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+    total.fetch_add(other.count(), std::memory_order_relaxed);
+    sumValue.fetch_add(other.sum(), std::memory_order_relaxed);
+    uint64_t value = other.max();
+    uint64_t prev = maxValue.load(std::memory_order_relaxed);
+    while (value > prev &&
+           !maxValue.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+    }
+}
@@ -0,0 +1,299 @@
+#include "load_generator.h"
+#include "counter.h"
+#include "logger.h"
+#include "process_manager.h"
+#include "latency_histogram.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Time for every load process to set up before the shared start
+const int kStartDelayMs = 200;
+
+// How long child jobs still queued or running at the end may take
+const int kDrainMs = 5000;
+
+// Longest sleep between checks of the running flag
+const int kMaxSleepMs = 100;
+
+enum LoadOp {
+    OpIncrement,
+    OpLog,
+    OpJob,
+    kLoadOps
+};
+
+const char* kOpNames[kLoadOps] = {"increment", "log", "job submit"};
+
+// Combined over every load process; forked processes share one copy
+struct LoadResults {
+    LatencyHistogram latencyNs[kLoadOps];
+    std::atomic<uint64_t> jobsRejected;
+    std::atomic<uint64_t> jobsCompleted; // including failed
+    std::atomic<uint64_t> jobsFailed;
+    std::atomic<int64_t> lastEndNs; // latest end of the timed phase
+    std::atomic<int> failedProcesses;
+};
+
+int64_t sinceEpochNs(Clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+// Runs each operation on its own fixed schedule, open loop: an operation
+// that runs late does not push back the ones after it, so a saturated box
+// shows up as achieved rates below target
+void runLoadThread(const LoadOptions& options, int index, LoadResults& results,
+                   Clock::time_point start, std::atomic<bool>& running) {
+    Counter& counter = Counter::getInstance();
+    Logger& logger = Logger::getInstance();
+    ProcessManager& pm = ProcessManager::getInstance();
+    
+    const double rates[kLoadOps] = {options.incrementsPerSec, options.logsPerSec,
+                                    options.jobsPerSec};
+    int shares = options.threads * options.processes;
+    Clock::duration interval[kLoadOps];
+    Clock::time_point next[kLoadOps];
+    for (int op = 0; op < kLoadOps; op++) {
+        if (rates[op] <= 0) {
+            next[op] = Clock::time_point::max();
+            continue;
+        }
+        interval[op] = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(shares / rates[op]));
+        // Spread the threads over the first interval rather than all at once
+        next[op] = start + interval[op] * index / shares;
+    }
+    
+    Clock::time_point end = start + options.duration;
+    int jobType = 1;
+    while (running.load(std::memory_order_relaxed)) {
+        int op = static_cast<int>(std::min_element(next, next + kLoadOps) - next);
+        if (next[op] >= end) {
+            break;
+        }
+        
+        // A saturated thread never catches up; stop on time regardless
+        Clock::time_point now = Clock::now();
+        if (now >= end) {
+            break;
+        }
+        if (now < next[op]) {
+            std::this_thread::sleep_until(
+                std::min(next[op], now + std::chrono::milliseconds(kMaxSleepMs)));
+            continue;
+        }
+        
+        int value = op == OpLog ? counter.getValue() : 0;
+        Clock::time_point opStart = Clock::now();
+        if (op == OpIncrement) {
+            counter.increment();
+        } else if (op == OpLog) {
+            logger.logWithTime("Load", value);
+        } else {
+            if (!pm.submitJob(jobType)) {
+                results.jobsRejected.fetch_add(1, std::memory_order_relaxed);
+            }
+            jobType = jobType == 1 ? 2 : 1;
+        }
+        results.latencyNs[op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - opStart).count());
+        next[op] += interval[op];
+    }
+}
+
+int runLoadProcess(const LoadOptions& options, int process, LoadResults& results,
+                   Clock::time_point start, std::atomic<bool>& running,
+                   const std::function<bool()>& setupProcess) {
+    if (!setupProcess()) {
+        results.failedProcesses.fetch_add(1);
+        return 1;
+    }
+    
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.threads; i++) {
+        int index = process * options.threads + i;
+        threads.emplace_back([&options, index, &results, start, &running]() {
+            runLoadThread(options, index, results, start, running);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    int64_t endNs = sinceEpochNs(Clock::now());
+    int64_t lastEnd = results.lastEndNs.load();
+    while (endNs > lastEnd && !results.lastEndNs.compare_exchange_weak(lastEnd, endNs)) {
+    }
+    
+    // Jobs still queued or running are part of the load
+    ProcessManager& pm = ProcessManager::getInstance();
+    Clock::time_point drainEnd = Clock::now() + std::chrono::milliseconds(kDrainMs);
+    while (running.load() && Clock::now() < drainEnd &&
+           (pm.hasActiveChildren() || pm.getJobQueueStats().queued > 0)) {
+        pm.checkFinishedProcesses();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    pm.cleanup();
+    
+    JobStats jobs = pm.getJobStats();
+    results.jobsCompleted.fetch_add(jobs.completed);
+    results.jobsFailed.fetch_add(jobs.failed);
+    
+    Logger& logger = Logger::getInstance();
+    logger.flush();
+    logger.close();
+    return 0;
+}
+
+void printLoadReport(const LoadOptions& options, const LoadResults& results, double elapsedSec,
+                     double wallSec, double userSec, double systemSec) {
+    printf("Load: %d process(es) x %d thread(s), %.1f s\n", options.processes,
+           options.threads, elapsedSec);
+    
+    const double rates[kLoadOps] = {options.incrementsPerSec, options.logsPerSec,
+                                    options.jobsPerSec};
+    for (int op = 0; op < kLoadOps; op++) {
+        if (rates[op] <= 0) {
+            continue;
+        }
+        const LatencyHistogram& latency = results.latencyNs[op];
+        printf("  %-10s target %10.1f/s, achieved %10.1f/s, p50 %.1f us, p99 %.1f us, "
+               "p999 %.1f us, max %.1f us\n",
+               kOpNames[op], rates[op], latency.count() / elapsedSec,
+               latency.percentile(0.5) / 1000.0, latency.percentile(0.99) / 1000.0,
+               latency.percentile(0.999) / 1000.0, latency.max() / 1000.0);
+    }
+    if (options.jobsPerSec > 0) {
+        printf("  jobs: %llu rejected, %llu completed, %llu failed\n",
+               static_cast<unsigned long long>(results.jobsRejected.load()),
+               static_cast<unsigned long long>(results.jobsCompleted.load()),
+               static_cast<unsigned long long>(results.jobsFailed.load()));
+    }
+    
+    // Over the whole run, child jobs and draining them included
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    double busy = (userSec + systemSec) / wallSec;
+    printf("  cpu: user %.2f s, system %.2f s, %.0f%% of one core, %.0f%% of %u cores\n",
+           userSec, systemSec, busy * 100.0, busy * 100.0 / cores, cores);
+}
+
+} // namespace
+
+LoadOptions::LoadOptions()
+    : threads(1), processes(1), incrementsPerSec(1000), logsPerSec(100), jobsPerSec(1),
+      duration(10000) {
+}
+
+int runLoad(const LoadOptions& requested, std::atomic<bool>& running,
+            const std::function<bool()>& setupProcess) {
+    LoadOptions options = requested;
+    options.threads = std::max(options.threads, 1);
+    options.processes = std::max(options.processes, 1);
+#ifdef _WIN32
+    if (options.processes > 1) {
+        fprintf(stderr, "Load processes need fork(); running one\n");
+        options.processes = 1;
+    }
+#endif
+    
+    printf("Load: increments %.1f/s, logs %.1f/s, jobs %.1f/s for %.1f s\n",
+           options.incrementsPerSec, options.logsPerSec, options.jobsPerSec,
+           options.duration.count() / 1000.0);
+    fflush(stdout);
+    
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(kStartDelayMs);
+    double userSec = 0;
+    double systemSec = 0;
+    
+#ifdef _WIN32
+    LoadResults* results = new LoadResults();
+    runLoadProcess(options, 0, *results, start, running, setupProcess);
+    
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+        auto seconds = [](const FILETIME& t) {
+            return ((static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 1e7;
+        };
+        userSec = seconds(user);
+        systemSec = seconds(kernel);
+    }
+#else
+    // Anonymous shared memory outlives nothing but the forked processes
+    void* mem = mmap(NULL, sizeof(LoadResults), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    LoadResults* results = new (mem) LoadResults();
+    
+    // Each load process sets up its own Logger and ProcessManager, so none
+    // of their threads exist yet when it is forked
+    fflush(stderr);
+    std::vector<pid_t> pids;
+    for (int i = 0; i < options.processes; i++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            running.store(false);
+            break;
+        }
+        if (pid == 0) {
+            exit(runLoadProcess(options, i, *results, start, running, setupProcess));
+        }
+        pids.push_back(pid);
+    }
+    
+    for (pid_t pid : pids) {
+        int status;
+        while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            results->failedProcesses.fetch_add(1);
+        }
+    }
+    
+    // Load processes reap their jobs, so this covers those too
+    struct rusage usage;
+    if (getrusage(RUSAGE_CHILDREN, &usage) == 0) {
+        userSec = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        systemSec = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    }
+#endif
+    
+    double wallSec = std::chrono::duration<double>(Clock::now() - start).count();
+    int status = 0;
+    if (results->failedProcesses.load() > 0 || results->lastEndNs.load() == 0) {
+        fprintf(stderr, "%d load process(es) failed\n", results->failedProcesses.load());
+        status = 1;
+    } else {
+        double elapsedSec = (results->lastEndNs.load() - sinceEpochNs(start)) / 1e9;
+        printLoadReport(options, *results, std::max(elapsedSec, 1e-3), std::max(wallSec, 1e-3),
+                        userSec, systemSec);
+    }
+    
+#ifdef _WIN32
+    delete results;
+#else
+    results->~LoadResults();
+    munmap(mem, sizeof(LoadResults));
+#endif
+    return status;
+}
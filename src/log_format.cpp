@@ -0,0 +1,261 @@
+#include "log_format.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+size_t putVarint(uint8_t* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+// Returns the bytes read, 0 if the varint is truncated, -1 if malformed
+long getVarint(const uint8_t* data, size_t size, uint64_t& value) {
+    value = 0;
+    for (size_t i = 0; i < size && i < 10; i++) {
+        value |= static_cast<uint64_t>(data[i] & 0x7f) << (7 * i);
+        if (!(data[i] & 0x80)) {
+            return static_cast<long>(i + 1);
+        }
+    }
+    return size < 10 ? 0 : -1;
+}
+
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+size_t putText(uint8_t* out, const char* text, size_t length) {
+    if (length > kBinaryMaxText) {
+        length = kBinaryMaxText;
+    }
+    size_t n = putVarint(out, length);
+    memcpy(out + n, text, length);
+    return n + length;
+}
+
+} // namespace
+
+BinaryLogEncoder::BinaryLogEncoder(int32_t pid)
+    : pid(pid), nextId(1), epoch(0), epochStartUs(0), lastTimestampUs(0),
+      resyncPending(false) {}
+
+bool BinaryLogEncoder::needsResync(int64_t timestampUs) const {
+    return epoch == 0 || resyncPending || timestampUs - epochStartUs >= kBinaryResyncUs ||
+           timestampUs < epochStartUs;
+}
+
+size_t BinaryLogEncoder::encodeHeader(uint8_t* out, uint8_t type, uint8_t flags,
+                                      int64_t timestampUs) {
+    if (needsResync(timestampUs)) {
+        resyncPending = false;
+        epoch++;
+        epochStartUs = timestampUs;
+        flags |= kBinaryAbsoluteTime;
+    }
+    
+    size_t n = 0;
+    out[n++] = static_cast<uint8_t>(kBinaryTagMarker | type | flags);
+    n += putVarint(out + n, static_cast<uint32_t>(pid));
+    if (flags & kBinaryAbsoluteTime) {
+        n += putVarint(out + n, static_cast<uint64_t>(timestampUs));
+    } else {
+        n += putVarint(out + n, zigzag(timestampUs - lastTimestampUs));
+    }
+    lastTimestampUs = timestampUs;
+    return n;
+}
+
+size_t BinaryLogEncoder::encodeEvent(uint8_t* out, int64_t timestampUs,
+                                     std::string_view message,
+                                     bool hasCounter, int64_t counterValue) {
+    size_t n = 0;
+    
+    // A new time base also invalidates earlier definitions for readers
+    // that start decoding from it
+    uint64_t recordEpoch = needsResync(timestampUs) ? epoch + 1 : epoch;
+    
+    auto it = messages.find(message);
+    if (it == messages.end()) {
+        if (messages.size() >= kBinaryMaxMessages) {
+            if (!hasCounter) {
+                return encodePrefixedText(out, timestampUs, message.data(), message.size());
+            }
+            // Same text as the logger writes for this event in text mode
+            char text[kBinaryMaxText + 1];
+            int length = snprintf(text, sizeof(text), "%.*s Counter: %lld",
+                                  static_cast<int>(message.size()), message.data(),
+                                  static_cast<long long>(counterValue));
+            size_t used = length < 0 ? 0 : static_cast<size_t>(length);
+            return encodePrefixedText(out, timestampUs, text,
+                                      used < sizeof(text) ? used : sizeof(text) - 1);
+        }
+        messageText.emplace_back(message);
+        it = messages.emplace(messageText.back(), Interned{nextId++, 0}).first;
+    }
+    if (it->second.epoch != recordEpoch) {
+        n += encodeHeader(out + n, kBinaryDefine, 0, timestampUs);
+        n += putVarint(out + n, it->second.id);
+        n += putText(out + n, message.data(), message.size());
+        it->second.epoch = epoch;
+    }
+    
+    n += encodeHeader(out + n, kBinaryEvent, hasCounter ? kBinaryHasCounter : 0, timestampUs);
+    n += putVarint(out + n, it->second.id);
+    if (hasCounter) {
+        n += putVarint(out + n, zigzag(counterValue));
+    }
+    return n;
+}
+
+size_t BinaryLogEncoder::encodeText(uint8_t* out, int64_t timestampUs, const std::string& text) {
+    return encodeText(out, timestampUs, text.data(), text.size());
+}
+
+size_t BinaryLogEncoder::encodeText(uint8_t* out, int64_t timestampUs, const char* text,
+                                    size_t length) {
+    size_t n = encodeHeader(out, kBinaryText, 0, timestampUs);
+    n += putText(out + n, text, length);
+    return n;
+}
+
+size_t BinaryLogEncoder::encodePrefixedText(uint8_t* out, int64_t timestampUs, const char* text,
+                                            size_t length) {
+    size_t n = encodeHeader(out, kBinaryText, kBinaryPrefixedText, timestampUs);
+    n += putText(out + n, text, length);
+    return n;
+}
+
+long BinaryLogDecoder::decode(const uint8_t* data, size_t size, BinaryLogRecord& record) {
+    if (size == 0) {
+        return 0;
+    }
+    
+    uint8_t tag = data[0];
+    if ((tag & 0xF0) != kBinaryTagMarker) {
+        return -1;
+    }
+    record.type = tag & kBinaryTypeMask;
+    record.hasCounter = record.type == kBinaryEvent && (tag & kBinaryHasCounter) != 0;
+    record.prefixed = record.type == kBinaryText && (tag & kBinaryPrefixedText) != 0;
+    if (record.type != kBinaryDefine && record.type != kBinaryEvent &&
+        record.type != kBinaryText) {
+        return -1;
+    }
+    
+    size_t pos = 1;
+    uint64_t pidValue, timeValue;
+    long n = getVarint(data + pos, size - pos, pidValue);
+    if (n <= 0) {
+        return n;
+    }
+    pos += n;
+    n = getVarint(data + pos, size - pos, timeValue);
+    if (n <= 0) {
+        return n;
+    }
+    pos += n;
+    
+    record.pid = static_cast<int32_t>(pidValue);
+    record.messageId = 0;
+    record.counterValue = 0;
+    record.text.clear();
+    
+    uint64_t value = 0;
+    if (record.type != kBinaryText) {
+        n = getVarint(data + pos, size - pos, value);
+        if (n <= 0) {
+            return n;
+        }
+        pos += n;
+        record.messageId = static_cast<uint32_t>(value);
+    }
+    
+    if (record.type == kBinaryEvent) {
+        if (record.hasCounter) {
+            n = getVarint(data + pos, size - pos, value);
+            if (n <= 0) {
+                return n;
+            }
+            pos += n;
+            record.counterValue = unzigzag(value);
+        }
+    } else {
+        n = getVarint(data + pos, size - pos, value);
+        if (n <= 0) {
+            return n;
+        }
+        pos += n;
+        if (value > kBinaryMaxText) {
+            return -1;
+        }
+        if (size - pos < value) {
+            return 0;
+        }
+        record.text.assign(reinterpret_cast<const char*>(data + pos), value);
+        pos += value;
+    }
+    
+    // Only commit decoder state once the whole record is available
+    PidState& state = pids[record.pid];
+    if (tag & kBinaryAbsoluteTime) {
+        state.lastTimestampUs = static_cast<int64_t>(timeValue);
+        state.haveBase = true;
+    } else {
+        state.lastTimestampUs += unzigzag(timeValue);
+    }
+    record.timestampUs = state.lastTimestampUs;
+    
+    if (record.type == kBinaryDefine) {
+        state.messages[record.messageId] = record.text;
+    } else if (record.type == kBinaryEvent) {
+        auto it = state.messages.find(record.messageId);
+        if (it != state.messages.end()) {
+            record.text = it->second;
+        } else {
+            record.text = "event#" + std::to_string(record.messageId);
+        }
+    }
+    
+    return static_cast<long>(pos);
+}
+
+bool BinaryLogDecoder::hasTimeBase(int32_t pid) const {
+    auto it = pids.find(pid);
+    return it != pids.end() && it->second.haveBase;
+}
+
+std::string formatBinaryRecord(const BinaryLogRecord& record) {
+    if (record.type == kBinaryText && !record.prefixed) {
+        return record.text;
+    }
+    
+    time_t seconds = static_cast<time_t>(record.timestampUs / 1000000);
+    int ms = static_cast<int>(record.timestampUs / 1000 % 1000);
+    struct tm timeinfo;
+#ifdef _WIN32
+    localtime_s(&timeinfo, &seconds);
+#else
+    localtime_r(&seconds, &timeinfo);
+#endif
+    char timestamp[32];
+    size_t length = strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    snprintf(timestamp + length, sizeof(timestamp) - length, ".%03d", ms);
+    
+    std::string line = timestamp;
+    line += " - PID: " + std::to_string(record.pid) + " - " + record.text;
+    if (record.hasCounter) {
+        line += " Counter: " + std::to_string(record.counterValue);
+    }
+    return line;
+}
@@ -0,0 +1,80 @@
+#include "log_ring.h"
+#include <cstring>
+
+LogRing::LogRing(size_t capacity) : mask(0), tail(0), head(0) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mask = size - 1;
+    
+    slots.reset(new Slot[size]);
+    for (size_t i = 0; i < size; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+        slots[i].length = 0;
+    }
+}
+
+bool LogRing::tryPush(const char* data, size_t length) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Slot* slot;
+    
+    for (;;) {
+        slot = &slots[pos & mask];
+        size_t seq = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // consumer has not released this slot yet
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+    
+    if (length > sizeof(slot->data)) {
+        // Keep the line terminator so truncated records stay one per line
+        length = sizeof(slot->data);
+        memcpy(slot->data, data, length - 1);
+        slot->data[length - 1] = '\n';
+    } else {
+        memcpy(slot->data, data, length);
+    }
+    slot->length = static_cast<uint32_t>(length);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+size_t LogRing::peek(LogRecordView* out, size_t max) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    size_t count = 0;
+    
+    while (count < max) {
+        Slot& slot = slots[(pos + count) & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + count + 1) {
+            break;
+        }
+        out[count].data = slot.data;
+        out[count].length = slot.length;
+        count++;
+    }
+    
+    return count;
+}
+
+void LogRing::release(size_t count) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; i++) {
+        slots[(pos + i) & mask].sequence.store(pos + i + mask + 1, std::memory_order_release);
+    }
+    head.store(pos + count, std::memory_order_release);
+}
+
+size_t LogRing::sizeApprox() const {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_relaxed);
+    return t > h ? t - h : 0;
+}
@@ -1,8 +1,13 @@
 #include "logger.h"
+#include "log_ring.h"
+#include "shared_log_ring.h"
+#include "log_format.h"
+#include "mapped_log_file.h"
+#include "process_stats.h"
 #include <iostream>
 #include <chrono>
-#include <iomanip>
-#include <sstream>
+#include <cstring>
+#include <ctime>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -10,14 +15,129 @@
 #else
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <cerrno>
 #endif
 
+namespace {
+
+// Records handed to a single writev call
+const size_t kMaxBatch = 256;
+
+const char* kSharedLogName = "/labwork_log_shm";
+
+// How long the drainer waits for a claimed record before skipping it
+const int kSharedStallMs = 1000;
+
+// How often a process without the drainer lease checks on the holder
+const int kDrainerProbeMs = 500;
+
+// Appends to a fixed buffer, dropping whatever does not fit
+class LineWriter {
+public:
+    LineWriter(char* buffer, size_t capacity) : buffer(buffer), capacity(capacity), used(0) {}
+    
+    size_t size() const { return used; }
+    
+    void append(const char* text, size_t length) {
+        size_t n = length < capacity - used ? length : capacity - used;
+        memcpy(buffer + used, text, n);
+        used += n;
+    }
+    
+    void appendUnsigned(uint64_t value) {
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value > 0);
+        while (n > 0 && used < capacity) {
+            buffer[used++] = digits[--n];
+        }
+    }
+    
+    void appendSigned(int64_t value) {
+        if (value < 0) {
+            append("-", 1);
+            appendUnsigned(0 - static_cast<uint64_t>(value));
+        } else {
+            appendUnsigned(static_cast<uint64_t>(value));
+        }
+    }
+    
+    void appendArg(const LogArg& arg) {
+        switch (arg.kind) {
+        case LogArg::Signed:
+            appendSigned(arg.signedValue);
+            break;
+        case LogArg::Unsigned:
+            appendUnsigned(arg.unsignedValue);
+            break;
+        case LogArg::Char: {
+            char c = static_cast<char>(arg.signedValue);
+            append(&c, 1);
+            break;
+        }
+        case LogArg::Text:
+            append(arg.text, arg.length);
+            break;
+        }
+    }
+    
+    // The format was checked by logf(), so braces come in pairs
+    void appendFormat(std::string_view format, const LogArg* args, size_t count) {
+        size_t next = 0;
+        size_t runStart = 0;
+        for (size_t i = 0; i < format.size(); i++) {
+            if (format[i] != '{' && format[i] != '}') {
+                continue;
+            }
+            append(format.data() + runStart, i - runStart);
+            if (format[i] == '{' && i + 1 < format.size() && format[i + 1] == '}' && next < count) {
+                appendArg(args[next++]);
+            } else {
+                append(format.data() + i, 1);
+            }
+            i++;
+            runStart = i + 1;
+        }
+        if (runStart < format.size()) {
+            append(format.data() + runStart, format.size() - runStart);
+        }
+    }
+
+private:
+    char* buffer;
+    size_t capacity;
+    size_t used;
+};
+
+// Publishes the time taken by one write to the log file
+void recordWriteTime(std::chrono::steady_clock::time_point start) {
+    ProcessStats::getInstance().slot().logWriteNs.record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+}
+
+} // namespace
+
 Logger& Logger::getInstance() {
     static Logger instance;
     return instance;
 }
 
-Logger::Logger() : logFile(nullptr) {
+Logger::Logger()
+    : logFile(nullptr),
+      writerRunning(false),
+      writerWakePending(false),
+      pendingDropReport(0),
+      drainerRunning(false),
+      statEnqueued(0),
+      statDropped(0),
+      statBatches(0),
+      statEnqueueNsTotal(0),
+      statEnqueueNsMax(0) {
 #ifdef _WIN32
     winProcessId = GetCurrentProcessId();
 #else
@@ -29,19 +149,67 @@ Logger::~Logger() {
     close();
 }
 
-bool Logger::initialize(const std::string& filename) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    this->filename = filename;
-    
+bool Logger::initialize(const std::string& filename, const LogOptions& options) {
+    {
+        std::lock_guard<std::mutex> lock(logMutex);
+        this->filename = filename;
+        this->options = options;
+        
+        if (options.format == LogFormat::Binary) {
 #ifdef _WIN32
-    logFile = _fsopen(filename.c_str(), "a", _SH_DENYNO);
+            encoder.reset(new BinaryLogEncoder(static_cast<int32_t>(winProcessId)));
 #else
-    logFile = fopen(filename.c_str(), "a");
+            encoder.reset(new BinaryLogEncoder(static_cast<int32_t>(processId)));
 #endif
-    
-    if (!logFile) {
-        std::cerr << "Failed to open log file: " << filename << std::endl;
-        return false;
+        }
+        
+        if (options.shared) {
+            sharedRing.reset(new SharedLogRing());
+            if (!sharedRing->open(kSharedLogName)) {
+                std::cerr << "Shared log unavailable, writing " << filename << " directly" << std::endl;
+                sharedRing.reset();
+            }
+        }
+        
+        // In shared mode only a potential drainer needs the file
+        bool needFile = !sharedRing || options.drainShared;
+        if (needFile && options.mapped) {
+            MappedLogOptions mappedOptions;
+            mappedOptions.segmentBytes = options.segmentBytes;
+            mappedOptions.maxAgeSec = options.rotateAgeSec;
+            mappedOptions.keepFiles = options.keepFiles;
+            mappedFile.reset(new MappedLogFile());
+            if (!mappedFile->open(filename, mappedOptions)) {
+                std::cerr << "Mapped log unavailable, appending to " << filename << std::endl;
+                mappedFile.reset();
+            }
+        }
+        
+        if (needFile && !mappedFile) {
+            const char* mode = options.format == LogFormat::Binary ? "ab" : "a";
+#ifdef _WIN32
+            logFile = _fsopen(filename.c_str(), mode, _SH_DENYNO);
+#else
+            logFile = fopen(filename.c_str(), mode);
+#endif
+            
+            if (!logFile) {
+                std::cerr << "Failed to open log file: " << filename << std::endl;
+                sharedRing.reset();
+                return false;
+            }
+        }
+        
+        if (sharedRing) {
+            if (options.drainShared && !drainerRunning.load()) {
+                drainerRunning.store(true);
+                drainerThread = std::thread(&Logger::drainerLoop, this);
+            }
+        } else if (options.async && !writerRunning.load()) {
+            ring.reset(new LogRing(options.ringCapacity));
+            writerRunning.store(true);
+            writerThread = std::thread(&Logger::writerLoop, this);
+        }
     }
     
     // Log startup
@@ -52,69 +220,403 @@ bool Logger::initialize(const std::string& filename) {
     startupMsg += std::to_string(processId);
 #endif
     startupMsg += " Time: " + getCurrentTime(true);
-    
-    fprintf(logFile, "%s\n", startupMsg.c_str());
-    fflush(logFile);
+    log(startupMsg);
     
     return true;
 }
 
 void Logger::log(const std::string& message) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    if (logFile) {
-        fprintf(logFile, "%s\n", message.c_str());
-        fflush(logFile);
+    if (pendingDropReport.load(std::memory_order_relaxed) > 0) {
+        reportDrops();
+    }
+    
+    if (encoder) {
+        uint8_t record[2 * kBinaryMaxRecord];
+        std::lock_guard<std::mutex> lock(binaryMutex);
+        size_t length = encoder->encodeText(record, currentTimeUs(), message);
+        emit(reinterpret_cast<const char*>(record), length);
+        return;
     }
+    
+    std::string line = message + "\n";
+    emit(line.data(), line.size());
 }
 
-void Logger::logWithTime(const std::string& prefix, int counterValue) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    if (logFile) {
-        std::string message = getCurrentTime(true) + " - ";
+void Logger::logWithTime(std::string_view prefix, int counterValue) {
+    if (pendingDropReport.load(std::memory_order_relaxed) > 0) {
+        reportDrops();
+    }
+    
+    if (encoder) {
+        uint8_t record[2 * kBinaryMaxRecord];
+        std::lock_guard<std::mutex> lock(binaryMutex);
+        size_t length = encoder->encodeEvent(record, currentTimeUs(), prefix,
+                                             counterValue >= 0, counterValue);
+        emit(reinterpret_cast<const char*>(record), length);
+        return;
+    }
+    
+    if (counterValue >= 0) {
+        logf(LOG_FMT("{} Counter: {}"), prefix, counterValue);
+    } else {
+        logf(LOG_FMT("{}"), prefix);
+    }
+}
+
+void Logger::logFormatted(std::string_view format, const LogArg* args, size_t count) {
+    if (pendingDropReport.load(std::memory_order_relaxed) > 0) {
+        reportDrops();
+    }
+    
+    // emit() is done with the line before it returns, so one per thread will do
+    thread_local char line[kMaxLogLine];
+    
+    if (encoder) {
+        LineWriter writer(line, sizeof(line));
+        writer.appendFormat(format, args, count);
+        uint8_t record[2 * kBinaryMaxRecord];
+        std::lock_guard<std::mutex> lock(binaryMutex);
+        size_t length = encoder->encodePrefixedText(record, currentTimeUs(), line,
+                                                    writer.size());
+        emit(reinterpret_cast<const char*>(record), length);
+        return;
+    }
+    
+    // Same layout as logWithTime; the last byte is kept for the newline
+    char timestamp[32];
+    LineWriter writer(line, sizeof(line) - 1);
+    writer.append(timestamp, formatCurrentTime(timestamp, sizeof(timestamp)));
+    writer.append(" - PID: ", 8);
 #ifdef _WIN32
-        message += "PID: " + std::to_string(winProcessId) + " - ";
+    writer.appendUnsigned(winProcessId);
 #else
-        message += "PID: " + std::to_string(processId) + " - ";
+    writer.appendSigned(processId);
 #endif
-        message += prefix;
-        if (counterValue >= 0) {
-            message += " Counter: " + std::to_string(counterValue);
+    writer.append(" - ", 3);
+    writer.appendFormat(format, args, count);
+    
+    size_t length = writer.size();
+    line[length++] = '\n';
+    emit(line, length);
+}
+
+void Logger::reportDrops() {
+    uint64_t dropped = pendingDropReport.exchange(0);
+    if (dropped > 0) {
+        log("Dropped " + std::to_string(dropped) + " log records");
+    }
+}
+
+int64_t Logger::currentTimeUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void Logger::emit(const char* data, size_t length) {
+    ProcessStatsSlot& stats = ProcessStats::getInstance().slot();
+    stats.logRecords.fetch_add(1, std::memory_order_relaxed);
+    stats.logBytes.fetch_add(length, std::memory_order_relaxed);
+    
+    // Queued records are timed per batch by writeBatch()
+    if (sharedRing || writerRunning.load(std::memory_order_relaxed)) {
+        enqueue(data, length);
+        return;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    if (mappedFile) {
+        mappedFile->append(data, length);
+    } else {
+        // One fwrite per record: binary records may contain NUL bytes
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (logFile) {
+            fwrite(data, 1, length, logFile);
+            fflush(logFile);
         }
-        fprintf(logFile, "%s\n", message.c_str());
-        fflush(logFile);
     }
+    recordWriteTime(start);
+}
+
+bool Logger::pushRecord(const char* data, size_t length) {
+    if (sharedRing) {
+        return sharedRing->tryPush(data, length);
+    }
+    return ring->tryPush(data, length);
+}
+
+void Logger::enqueue(const char* data, size_t length) {
+    auto start = std::chrono::steady_clock::now();
+    
+    bool pushed = pushRecord(data, length);
+    while (!pushed && options.overflow == LogOverflowPolicy::Block) {
+        if (!sharedRing) {
+            wakeWriter();
+        }
+        std::this_thread::yield();
+        pushed = pushRecord(data, length);
+    }
+    
+    if (pushed) {
+        statEnqueued.fetch_add(1, std::memory_order_relaxed);
+        if (!sharedRing && ring->sizeApprox() >= options.flushBatchRecords) {
+            wakeWriter();
+        }
+    } else {
+        statDropped.fetch_add(1, std::memory_order_relaxed);
+        // The lost record may have carried a Define or the delta base.
+        // Binary records are emitted with binaryMutex held.
+        if (encoder) {
+            encoder->forceResync();
+        }
+        if (options.overflow == LogOverflowPolicy::Count) {
+            pendingDropReport.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    statEnqueueNsTotal.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t prevMax = statEnqueueNsMax.load(std::memory_order_relaxed);
+    while (ns > prevMax &&
+           !statEnqueueNsMax.compare_exchange_weak(prevMax, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void Logger::wakeWriter() {
+    if (!writerWakePending.exchange(true)) {
+        writerCv.notify_one();
+    }
+}
+
+void Logger::writerLoop() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(writerMutex);
+            writerCv.wait_for(lock, std::chrono::milliseconds(options.flushIntervalMs), [this] {
+                return !writerRunning.load() || writerWakePending.load();
+            });
+            writerWakePending.store(false);
+        }
+        
+        bool stopping = !writerRunning.load();
+        drainRing();
+        
+        flushedCv.notify_all();
+        if (stopping && ring->sizeApprox() == 0) {
+            break;
+        }
+    }
+}
+
+size_t Logger::drainRing() {
+    LogRecordView views[kMaxBatch];
+    size_t total = 0;
+    
+    for (;;) {
+        size_t count = ring->peek(views, kMaxBatch);
+        if (count == 0) {
+            break;
+        }
+        writeBatch(views, count);
+        ring->release(count);
+        total += count;
+    }
+    
+    return total;
+}
+
+void Logger::drainerLoop() {
+    while (drainerRunning.load()) {
+        if (sharedRing->tryAcquireDrainer()) {
+            drainSharedRing();
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.flushIntervalMs));
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kDrainerProbeMs));
+        }
+    }
+    
+    if (sharedRing->isDrainer()) {
+        drainSharedRing();
+        sharedRing->releaseDrainer();
+    }
+}
+
+size_t Logger::drainSharedRing() {
+    LogRecordView views[kMaxBatch];
+    size_t total = 0;
+    
+    for (;;) {
+        size_t count = sharedRing->peek(views, kMaxBatch, kSharedStallMs);
+        if (count == 0) {
+            break;
+        }
+        writeBatch(views, count);
+        sharedRing->release(count);
+        total += count;
+    }
+    
+    return total;
+}
+
+void Logger::writeBatch(const LogRecordView* views, size_t count) {
+    statBatches.fetch_add(1, std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    if (mappedFile) {
+        mappedFile->append(views, count);
+        recordWriteTime(start);
+        return;
+    }
+    
+#ifdef _WIN32
+    for (size_t i = 0; i < count; i++) {
+        fwrite(views[i].data, 1, views[i].length, logFile);
+    }
+    fflush(logFile);
+#else
+    struct iovec iov[kMaxBatch];
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = const_cast<char*>(views[i].data);
+        iov[i].iov_len = views[i].length;
+    }
+    
+    // One writev per batch; only a short write needs another call
+    struct iovec* cur = iov;
+    int left = static_cast<int>(count);
+    while (left > 0) {
+        ssize_t written = writev(fileno(logFile), cur, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("writev");
+            break;
+        }
+        while (left > 0 && static_cast<size_t>(written) >= cur->iov_len) {
+            written -= cur->iov_len;
+            cur++;
+            left--;
+        }
+        if (left > 0) {
+            cur->iov_base = static_cast<char*>(cur->iov_base) + written;
+            cur->iov_len -= written;
+        }
+    }
+#endif
+    recordWriteTime(start);
+}
+
+void Logger::flush() {
+    if (sharedRing) {
+        // Wait for whichever process holds the lease, but not forever:
+        // there may be no drainer at all
+        uint64_t target = sharedRing->tailPosition();
+        for (int i = 0; i < kSharedStallMs && sharedRing->headPosition() < target; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return;
+    }
+    
+    if (!writerRunning.load()) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (logFile) {
+            fflush(logFile);
+        }
+        return;
+    }
+    
+    size_t target = ring->tailPosition();
+    std::unique_lock<std::mutex> lock(writerMutex);
+    while (writerRunning.load() && ring->headPosition() < target) {
+        wakeWriter();
+        flushedCv.wait_for(lock, std::chrono::milliseconds(options.flushIntervalMs));
+    }
+}
+
+LogStats Logger::getStats() const {
+    LogStats stats;
+    stats.enqueued = statEnqueued.load();
+    stats.dropped = statDropped.load();
+    stats.batches = statBatches.load();
+    stats.enqueueNsTotal = statEnqueueNsTotal.load();
+    stats.enqueueNsMax = statEnqueueNsMax.load();
+    return stats;
 }
 
 std::string Logger::getCurrentTime(bool withMilliseconds) {
+    char buffer[32];
+    size_t length = formatCurrentTime(buffer, sizeof(buffer), withMilliseconds);
+    return std::string(buffer, length);
+}
+
+size_t Logger::formatCurrentTime(char* buffer, size_t size, bool withMilliseconds) {
+    // "YYYY-MM-DD HH:MM:SS" is 19 characters, ".mmm" adds 4
+    const size_t kSecondsLength = 19;
+    size_t length = withMilliseconds ? kSecondsLength + 4 : kSecondsLength;
+    if (size < length + 1) {
+        return 0;
+    }
+    
+    struct SecondCache {
+        time_t second = -1;
+        char text[kSecondsLength + 1];
+    };
+    thread_local SecondCache cache;
+    
     auto now = std::chrono::system_clock::now();
     auto time = std::chrono::system_clock::to_time_t(now);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+    int ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
         now.time_since_epoch()
-    ) % 1000;
-    
-    std::stringstream ss;
+    ).count() % 1000);
     
-    // For Windows, use safe localtime_s
+    if (time != cache.second) {
+        struct tm timeinfo;
 #ifdef _WIN32
-    struct tm timeinfo;
-    localtime_s(&timeinfo, &time);
-    ss << std::put_time(&timeinfo, "%Y-%m-%d %H:%M:%S");
+        localtime_s(&timeinfo, &time);
 #else
-    char buffer[80];
-    struct tm* timeinfo = localtime(&time);
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
-    ss << buffer;
+        localtime_r(&time, &timeinfo);
 #endif
+        strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S", &timeinfo);
+        cache.second = time;
+    }
     
+    memcpy(buffer, cache.text, kSecondsLength);
     if (withMilliseconds) {
-        ss << "." << std::setfill('0') << std::setw(3) << ms.count();
+        buffer[kSecondsLength] = '.';
+        buffer[kSecondsLength + 1] = static_cast<char>('0' + ms / 100);
+        buffer[kSecondsLength + 2] = static_cast<char>('0' + ms / 10 % 10);
+        buffer[kSecondsLength + 3] = static_cast<char>('0' + ms % 10);
     }
-    
-    return ss.str();
+    buffer[length] = '\0';
+    return length;
 }
 
 void Logger::close() {
+    if (pendingDropReport.load() > 0 && (sharedRing || writerRunning.load())) {
+        reportDrops();
+    }
+    
+    if (drainerRunning.exchange(false)) {
+        if (drainerThread.joinable()) {
+            drainerThread.join();
+        }
+    }
+    if (sharedRing) {
+        sharedRing->close();
+        sharedRing.reset();
+    }
+    
+    if (writerRunning.exchange(false)) {
+        writerCv.notify_one();
+        if (writerThread.joinable()) {
+            writerThread.join();
+        }
+    }
+    
     std::lock_guard<std::mutex> lock(logMutex);
+    if (mappedFile) {
+        mappedFile->close();
+        mappedFile.reset();
+    }
     if (logFile) {
         fclose(logFile);
         logFile = nullptr;
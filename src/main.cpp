@@ -1,14 +1,26 @@
 #include "counter.h"
+#include "counter_registry.h"
+#include "counter_checkpoint.h"
 #include "logger.h"
 #include "process_manager.h"
+#include "worker_pool.h"
+#include "child_job.h"
+#include "scheduler.h"
+#include "latency_histogram.h"
+#include "master_election.h"
+#include "process_stats.h"
+#include "load_generator.h"
 #include <iostream>
 #include <thread>
 #include <chrono>
 #include <atomic>
 #include <csignal>
 #include <string>
+#include <vector>
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
+#include <cerrno>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -16,76 +28,165 @@
 #else
 #include <unistd.h>
 #include <termios.h>
-#include <sys/select.h>
+#include <fcntl.h>
 #endif
 
 std::atomic<bool> running(true);
+// Cleared to stop the worker thread alone, e.g. when this process changes role
+std::atomic<bool> workerRunning(true);
+
+// Counter tick configuration; tick lateness goes to this process's stats slot
+std::chrono::microseconds tickPeriod(300000);
+MissedTicks tickPolicy = MissedTicks::Skip;
+std::atomic<uint64_t> finishedWorkerMissedTicks(0);
+// Missed ticks of every worker so far, published by the worker thread so
+// nobody else has to read its Scheduler
+std::atomic<uint64_t> missedTickTotal(0);
+std::atomic<bool> jitterDumpRequested(false);
+
+// Counter checkpoints written by the master; null without --counter-file
+CounterCheckpoint* counterCheckpoint = nullptr;
+std::chrono::milliseconds checkpointPeriod(1000);
+
+// Event loop of the main thread, which reads stdin
+std::atomic<Scheduler*> inputScheduler(nullptr);
+
+void shutdown();
 
 // Signal handler
 void signalHandler(int signal) {
-    running.store(false);
+    shutdown();
 }
 
+#ifndef _WIN32
+void jitterSignalHandler(int) {
+    jitterDumpRequested.store(true);
+    Scheduler* scheduler = inputScheduler.load();
+    if (scheduler) {
+        scheduler->wake();
+    }
+}
+#endif
+
+#ifdef _WIN32
 // Non-blocking keyboard input check
 bool kbhit() {
-#ifdef _WIN32
     return _kbhit() != 0;
+}
 #else
-    struct termios oldt, newt;
-    int ch;
-    int oldf;
-    
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
-    
-    ch = getchar();
-    
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    fcntl(STDIN_FILENO, F_SETFL, oldf);
-    
-    if (ch != EOF) {
-        ungetc(ch, stdin);
-        return true;
+// Terminal settings of stdin before it was switched to raw mode
+struct termios savedTermios;
+bool terminalRaw = false;
+
+void restoreTerminal() {
+    if (terminalRaw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &savedTermios);
+        terminalRaw = false;
+    }
+}
+
+// Switches a terminal on stdin to unbuffered, non-echoing input once for the
+// whole run. Pipes and files are left alone.
+void enterRawMode() {
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &savedTermios) == -1) {
+        return;
     }
     
-    return false;
-#endif
+    struct termios raw = savedTermios;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0) {
+        terminalRaw = true;
+        atexit(restoreTerminal);
+    }
 }
+#endif
 
 // Child process logic
-void runAsChild(int type) {
+void runAsChild(int type, const std::string& logName, LogOptions logOptions) {
     Logger& logger = Logger::getInstance();
-    Counter& counter = Counter::getInstance();
+    ProcessStats::getInstance().setRole(StatsRole::Child);
     
-    logger.initialize("lab.log");
-    logger.logWithTime("Child " + std::to_string(type) + " started");
+    // Children are short-lived; leave draining a shared log to others
+    logOptions.drainShared = false;
+    logger.initialize(logName, logOptions);
     
-    int currentValue = counter.getValue();
+    runChildJob(type);
+    logger.close();
     
-    if (type == 1) {
-        // Type 1: increase by 10
-        counter.setValue(currentValue + 10);
-        logger.logWithTime("Child 1 increased counter by 10");
-    } else if (type == 2) {
-        // Type 2: multiply by 2, wait 2 seconds, divide by 2
-        counter.setValue(currentValue * 2);
-        logger.logWithTime("Child 2 multiplied counter by 2");
-        
-        std::this_thread::sleep_for(std::chrono::seconds(2));
-        
-        currentValue = counter.getValue();
-        counter.setValue(currentValue / 2);
-        logger.logWithTime("Child 2 divided counter by 2");
-    }
+    exit(0);
+}
+
+// Pool worker logic: set up once, then run jobs until the pool stops
+int runAsWorker(const std::string& poolName, int slot, const std::string& logName,
+                LogOptions logOptions) {
+    Logger& logger = Logger::getInstance();
+    ProcessStats::getInstance().setRole(StatsRole::Worker);
+    
+    logOptions.drainShared = false;
+    logger.initialize(logName, logOptions);
     
-    logger.logWithTime("Child " + std::to_string(type) + " finished");
+    int status = WorkerPool::serve(poolName.c_str(), slot, runChildJob);
     logger.close();
+    return status;
+}
+
+// Scheduler of the current worker thread, so stopping can wake it
+std::atomic<Scheduler*> workerScheduler(nullptr);
+
+void stopWorker() {
+    workerRunning.store(false);
+    Scheduler* scheduler = workerScheduler.load();
+    if (scheduler) {
+        scheduler->stop();
+    }
+}
+
+// Stops the worker and the input loop; safe to call from signal handlers
+void shutdown() {
+    running.store(false);
+    stopWorker();
+    Scheduler* scheduler = inputScheduler.load();
+    if (scheduler) {
+        scheduler->stop();
+    }
+}
+
+void runWorker(Scheduler& scheduler) {
+    workerScheduler.store(&scheduler);
+    scheduler.run(workerRunning);
+    workerScheduler.store(nullptr);
+    finishedWorkerMissedTicks.fetch_add(scheduler.missedTicks());
+    missedTickTotal.store(finishedWorkerMissedTicks.load());
+}
+
+// Counter tick of both roles, on the worker thread
+void tick(Counter& counter, const Scheduler& scheduler) {
+    counter.increment();
+    uint64_t missed = finishedWorkerMissedTicks.load() + scheduler.missedTicks();
+    missedTickTotal.store(missed, std::memory_order_relaxed);
+    ProcessStats::getInstance().slot().ticksMissed.store(missed, std::memory_order_relaxed);
+}
+
+void dumpTickJitter() {
+    const LatencyHistogram& tickLateness = ProcessStats::getInstance().slot().tickLatenessNs;
+    uint64_t missed = missedTickTotal.load();
     
-    exit(0);
+    char line[256];
+    snprintf(line, sizeof(line),
+             "Tick lateness (period %lld us): ticks %llu, p50 %.1f us, p99 %.1f us, "
+             "p999 %.1f us, max %.1f us, missed %llu",
+             static_cast<long long>(tickPeriod.count()),
+             static_cast<unsigned long long>(tickLateness.count()),
+             tickLateness.percentile(0.5) / 1000.0,
+             tickLateness.percentile(0.99) / 1000.0,
+             tickLateness.percentile(0.999) / 1000.0,
+             tickLateness.max() / 1000.0,
+             static_cast<unsigned long long>(missed));
+    
+    std::cout << line << std::endl;
+    Logger::getInstance().logf(LOG_FMT("{}"), line);
 }
 
 // Master process logic
@@ -95,66 +196,113 @@ void runMaster() {
     ProcessManager& pm = ProcessManager::getInstance();
     
     pm.setMasterMode(true);
+    ProcessStats::getInstance().setRole(StatsRole::Master);
     
-    auto lastIncrement = std::chrono::steady_clock::now();
-    auto lastLog = std::chrono::steady_clock::now();
-    auto lastChildLaunch = std::chrono::steady_clock::now();
+    Scheduler scheduler;
     
-    while (running.load()) {
-        auto now = std::chrono::steady_clock::now();
-        
-        // Increment every 300ms
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - lastIncrement).count() >= 300) {
-            counter.increment();
-            lastIncrement = now;
-        }
-        
-        // Log every 1 second
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - lastLog).count() >= 1000) {
-            logger.logWithTime("Master log", counter.getValue());
-            lastLog = now;
-        }
-        
-        // Launch child processes every 3 seconds
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - lastChildLaunch).count() >= 3000) {
-            
-            pm.checkFinishedProcesses();
-            
-            if (!pm.hasActiveChildren()) {
-                if (pm.launchChildProcess(1) && pm.launchChildProcess(2)) {
-                    logger.logWithTime("Launched child processes 1 and 2");
-                }
-            } else {
-                logger.logWithTime("Previous child processes still active, skipping launch");
+    // Increment every tick (300ms by default)
+    scheduler.addPeriodic(tickPeriod, [&counter, &scheduler]() {
+        tick(counter, scheduler);
+    }, tickPolicy, &ProcessStats::getInstance().slot().tickLatenessNs);
+    
+    // Log every 1 second
+    scheduler.addPeriodic(std::chrono::milliseconds(1000), [&logger, &counter]() {
+        logger.logWithTime("Master log", counter.getValue());
+    });
+    
+    if (counterCheckpoint) {
+        scheduler.addPeriodic(checkpointPeriod, [&logger, &counter]() {
+            if (!counterCheckpoint->write(counter.getValue())) {
+                logger.logf(LOG_FMT("Counter checkpoint to {} failed"),
+                            counterCheckpoint->getPath());
             }
-            
-            lastChildLaunch = now;
+        });
+    }
+    
+    // Queue child jobs every 3 seconds; each starts as soon as its type has
+    // a free slot
+    scheduler.addPeriodic(std::chrono::milliseconds(3000), [&logger, &pm]() {
+        pm.checkFinishedProcesses();
+        
+        bool queued1 = pm.submitJob(1);
+        bool queued2 = pm.submitJob(2);
+        if (queued1 && queued2) {
+            logger.logWithTime("Queued child jobs 1 and 2");
+        } else {
+            logger.logf(LOG_FMT("Job queue full, rejected{}{}"), queued1 ? "" : " job 1",
+                        queued2 ? "" : " job 2");
         }
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
+        JobQueueStats queue = pm.getJobQueueStats();
+        char line[200];
+        snprintf(line, sizeof(line),
+                 "Job queue: depth %zu, running %zu, wait p50 %llu us, p99 %llu us, "
+                 "%.2f completed/s, %llu rejected",
+                 queue.queued, queue.running,
+                 static_cast<unsigned long long>(queue.waitP50Us),
+                 static_cast<unsigned long long>(queue.waitP99Us),
+                 queue.completedPerSecond,
+                 static_cast<unsigned long long>(queue.rejected));
+        logger.logf(LOG_FMT("{}"), line);
+    });
+    
+    runWorker(scheduler);
 }
 
 // Slave process logic
 void runSlave() {
     Counter& counter = Counter::getInstance();
+    ProcessStats::getInstance().setRole(StatsRole::Slave);
     
-    auto lastIncrement = std::chrono::steady_clock::now();
+    Scheduler scheduler;
     
-    while (running.load()) {
-        auto now = std::chrono::steady_clock::now();
-        
-        // Increment every 300ms
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - lastIncrement).count() >= 300) {
-            counter.increment();
-            lastIncrement = now;
+    // Increment every tick (300ms by default)
+    scheduler.addPeriodic(tickPeriod, [&counter, &scheduler]() {
+        tick(counter, scheduler);
+    }, tickPolicy, &ProcessStats::getInstance().slot().tickLatenessNs);
+    
+    runWorker(scheduler);
+}
+
+// `labwork --stats`: reads every process's stats slot without touching
+// the counter, the log or the election
+int runStats(bool watch, const std::string& prometheusPath, std::chrono::milliseconds interval) {
+    StatsReader reader;
+    if (!reader.open()) {
+        return 1;
+    }
+    
+#ifdef _WIN32
+    SetConsoleCtrlHandler([](DWORD signal) -> BOOL {
+        if (signal == CTRL_C_EVENT) {
+            shutdown();
+            return TRUE;
+        }
+        return FALSE;
+    }, TRUE);
+#else
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+#endif
+    
+    while (true) {
+        reader.printTable(stdout);
+        fflush(stdout);
+        if (!prometheusPath.empty() && !reader.writePrometheus(prometheusPath)) {
+            return 1;
+        }
+        if (!watch) {
+            return 0;
         }
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        auto next = std::chrono::steady_clock::now() + interval;
+        while (running.load() && std::chrono::steady_clock::now() < next) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        if (!running.load()) {
+            return 0;
+        }
+        printf("\n");
     }
 }
 
@@ -162,25 +310,165 @@ int main(int argc, char* argv[]) {
     // Handle command line arguments
     bool isChild = false;
     int childType = 0;
+    std::string workerPool;
+    int workerSlot = -1;
+    int poolWorkers = 0;
+    std::vector<std::pair<int, int>> concurrencyLimits; // type (-1: all), limit
+    long maxQueued = -1;
+    CounterMode counterMode = CounterMode::Single;
+    LaunchMethod launchMethod = LaunchMethod::Spawn;
+    long failoverMs = 1000;
+    ChildMode childMode = ChildMode::Process;
+    LogOptions logOptions;
+    std::string logName = "lab.log";
+    std::string counterFile;
+    std::vector<std::string> childArgs;
+    bool showStats = false;
+    bool watchStats = false;
+    std::string prometheusPath;
+    std::chrono::milliseconds statsInterval(1000);
+    bool loadMode = false;
+    LoadOptions loadOptions;
     
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--child") == 0 && i + 1 < argc) {
             isChild = true;
-            childType = std::stoi(argv[i + 1]);
-            break;
+            childType = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--worker") == 0 && i + 2 < argc) {
+            workerPool = argv[++i];
+            workerSlot = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--max-concurrency=", 18) == 0) {
+            // N for every type, or TYPE:N
+            const char* value = argv[i] + 18;
+            const char* colon = strchr(value, ':');
+            if (colon) {
+                concurrencyLimits.emplace_back(atoi(value), atoi(colon + 1));
+            } else {
+                concurrencyLimits.emplace_back(-1, atoi(value));
+            }
+        } else if (strncmp(argv[i], "--max-queued=", 13) == 0) {
+            maxQueued = atol(argv[i] + 13);
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            poolWorkers = atoi(argv[i] + 10);
+        } else if (strcmp(argv[i], "--async-log") == 0) {
+            logOptions.async = true;
+            childArgs.push_back(argv[i]);
+        } else if (strcmp(argv[i], "--binary-log") == 0) {
+            logOptions.format = LogFormat::Binary;
+            logName = "lab.bin";
+            childArgs.push_back(argv[i]);
+        } else if (strcmp(argv[i], "--mapped-log") == 0) {
+            logOptions.mapped = true;
+            childArgs.push_back(argv[i]);
+        } else if (strncmp(argv[i], "--log-segment-mb=", 17) == 0) {
+            logOptions.segmentBytes = static_cast<size_t>(atol(argv[i] + 17)) << 20;
+            childArgs.push_back(argv[i]);
+        } else if (strncmp(argv[i], "--log-rotate-sec=", 17) == 0) {
+            logOptions.rotateAgeSec = atoi(argv[i] + 17);
+            childArgs.push_back(argv[i]);
+        } else if (strcmp(argv[i], "--shared-log") == 0) {
+            logOptions.shared = true;
+            childArgs.push_back(argv[i]);
+        } else if (strcmp(argv[i], "--log-overflow=block") == 0) {
+            logOptions.overflow = LogOverflowPolicy::Block;
+            childArgs.push_back(argv[i]);
+        } else if (strcmp(argv[i], "--log-overflow=drop") == 0) {
+            logOptions.overflow = LogOverflowPolicy::Drop;
+            childArgs.push_back(argv[i]);
+        } else if (strcmp(argv[i], "--log-overflow=count") == 0) {
+            logOptions.overflow = LogOverflowPolicy::Count;
+            childArgs.push_back(argv[i]);
+        } else if (strncmp(argv[i], "--tick-us=", 10) == 0) {
+            long long us = atoll(argv[i] + 10);
+            tickPeriod = std::chrono::microseconds(us > 0 ? us : 1);
+        } else if (strcmp(argv[i], "--missed-ticks=skip") == 0) {
+            tickPolicy = MissedTicks::Skip;
+        } else if (strcmp(argv[i], "--missed-ticks=catchup") == 0) {
+            tickPolicy = MissedTicks::CatchUp;
+        } else if (strcmp(argv[i], "--child-mode=process") == 0) {
+            childMode = ChildMode::Process;
+        } else if (strcmp(argv[i], "--child-mode=thread") == 0) {
+            childMode = ChildMode::Thread;
+        } else if (strncmp(argv[i], "--failover-ms=", 14) == 0) {
+            failoverMs = atol(argv[i] + 14);
+        } else if (strcmp(argv[i], "--launch=fork") == 0) {
+            launchMethod = LaunchMethod::Fork;
+        } else if (strcmp(argv[i], "--launch=spawn") == 0) {
+            launchMethod = LaunchMethod::Spawn;
+        } else if (strncmp(argv[i], "--counter-file=", 15) == 0) {
+            counterFile = argv[i] + 15;
+        } else if (strncmp(argv[i], "--checkpoint-ms=", 16) == 0) {
+            long ms = atol(argv[i] + 16);
+            checkpointPeriod = std::chrono::milliseconds(ms > 0 ? ms : 1);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            showStats = true;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watchStats = true;
+        } else if (strncmp(argv[i], "--prometheus=", 13) == 0) {
+            prometheusPath = argv[i] + 13;
+        } else if (strncmp(argv[i], "--interval-ms=", 14) == 0) {
+            long ms = atol(argv[i] + 14);
+            statsInterval = std::chrono::milliseconds(ms > 0 ? ms : 1);
+        } else if (strcmp(argv[i], "--load") == 0) {
+            loadMode = true;
+        } else if (strncmp(argv[i], "--load-threads=", 15) == 0) {
+            loadOptions.threads = atoi(argv[i] + 15);
+        } else if (strncmp(argv[i], "--load-processes=", 17) == 0) {
+            loadOptions.processes = atoi(argv[i] + 17);
+        } else if (strncmp(argv[i], "--load-inc-rate=", 16) == 0) {
+            loadOptions.incrementsPerSec = atof(argv[i] + 16);
+        } else if (strncmp(argv[i], "--load-log-rate=", 16) == 0) {
+            loadOptions.logsPerSec = atof(argv[i] + 16);
+        } else if (strncmp(argv[i], "--load-job-rate=", 16) == 0) {
+            loadOptions.jobsPerSec = atof(argv[i] + 16);
+        } else if (strncmp(argv[i], "--load-sec=", 11) == 0) {
+            double sec = atof(argv[i] + 11);
+            loadOptions.duration = std::chrono::milliseconds(sec > 0 ? static_cast<long long>(sec * 1000) : 1);
+        } else if (strcmp(argv[i], "--counter-mode=single") == 0) {
+            counterMode = CounterMode::Single;
+        } else if (strcmp(argv[i], "--counter-mode=cpu") == 0) {
+            counterMode = CounterMode::ShardedPerCpu;
+        } else if (strcmp(argv[i], "--counter-mode=process") == 0) {
+            counterMode = CounterMode::ShardedPerProcess;
         }
     }
     
+    if (showStats) {
+        return runStats(watchStats, prometheusPath, statsInterval);
+    }
+    
+    // Read the checkpoint before the counter segment is mapped: the value
+    // only seeds the segment if this process is the one creating it
+    CounterCheckpoint checkpoint;
+    int64_t checkpointValue = 0;
+    bool haveCheckpoint = false;
+    if (!counterFile.empty() && !isChild && workerPool.empty()) {
+        if (!checkpoint.open(counterFile)) {
+            std::cerr << "Counter will not be persisted" << std::endl;
+        } else {
+            counterCheckpoint = &checkpoint;
+            haveCheckpoint = checkpoint.read(checkpointValue);
+            if (haveCheckpoint) {
+                CounterRegistry::setInitialDefaultValue(static_cast<int>(checkpointValue));
+            }
+        }
+    }
+    
+    Counter::getInstance().setMode(counterMode);
+    
     if (isChild) {
-        runAsChild(childType);
+        runAsChild(childType, logName, logOptions);
         return 0;
     }
+    if (!workerPool.empty()) {
+        return runAsWorker(workerPool, workerSlot, logName, logOptions);
+    }
     
     // Set up signal handlers
 #ifdef _WIN32
     SetConsoleCtrlHandler([](DWORD signal) -> BOOL {
         if (signal == CTRL_C_EVENT) {
-            running.store(false);
+            shutdown();
             return TRUE;
         }
         return FALSE;
@@ -188,22 +476,68 @@ int main(int argc, char* argv[]) {
 #else
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
+    signal(SIGUSR1, jitterSignalHandler);
 #endif
     
+    // Applies the command line to this process's ProcessManager
+    auto configureProcessManager = [&](ProcessManager& pm) {
+        pm.setChildArguments(childArgs);
+        pm.setLaunchMethod(launchMethod);
+        pm.setChildMode(childMode);
+        for (const auto& limit : concurrencyLimits) {
+            for (int type = 0; type < kMaxChildTypes; type++) {
+                if (limit.first == -1 || limit.first == type) {
+                    pm.setMaxConcurrency(type, limit.second);
+                }
+            }
+        }
+        if (maxQueued >= 0) {
+            pm.setMaxQueuedJobs(static_cast<size_t>(maxQueued));
+        }
+    };
+    
+    // Only a process that submits jobs needs the pool
+    auto startWorkerPool = [&](ProcessManager& pm) {
+        if (childMode == ChildMode::Process && poolWorkers > 0 && !pm.startWorkerPool(poolWorkers)) {
+            std::cerr << "Failed to start worker pool, launching a process per job" << std::endl;
+        }
+    };
+    
+    if (loadMode) {
+        return runLoad(loadOptions, running, [&]() {
+            // Before the logger's writer or drainer thread: it blocks SIGCHLD
+            ProcessManager& pm = ProcessManager::getInstance();
+            if (!Logger::getInstance().initialize(logName, logOptions)) {
+                std::cerr << "Failed to initialize logger" << std::endl;
+                return false;
+            }
+            configureProcessManager(pm);
+            startWorkerPool(pm);
+            return true;
+        });
+    }
+    
+    // Before any thread starts: it blocks SIGCHLD for child reaping
+    ProcessManager& pm = ProcessManager::getInstance();
+    
     // Initialize components
     Logger& logger = Logger::getInstance();
-    if (!logger.initialize("lab.log")) {
+    if (!logger.initialize(logName, logOptions)) {
         std::cerr << "Failed to initialize logger" << std::endl;
         return 1;
     }
     
     Counter& counter = Counter::getInstance();
-    ProcessManager& pm = ProcessManager::getInstance();
+    if (haveCheckpoint && CounterRegistry::getInstance().created()) {
+        logger.logf(LOG_FMT("Restored counter to {} from {}"), checkpointValue, counterFile);
+    }
+    configureProcessManager(pm);
     
-    // Try to become master
-    // Simple approach: first process to write to log becomes master
-    bool isMaster = true; // For simplicity, all processes can become masters
-    // In a real implementation, you would use inter-process synchronization
+    // One instance wins the shared lease and runs the master duties; the
+    // others keep polling so that one of them takes over if it goes away
+    MasterElection& election = MasterElection::getInstance();
+    election.setFailoverTimeout(std::chrono::milliseconds(failoverMs));
+    bool isMaster = election.poll();
     
     std::cout << "Lab program started. PID: ";
 #ifdef _WIN32
@@ -215,14 +549,17 @@ int main(int argc, char* argv[]) {
     std::cout << "Commands:" << std::endl;
     std::cout << "  Enter a number to set counter value" << std::endl;
     std::cout << "  'q' to quit" << std::endl;
-    std::cout << "  'm' to toggle master mode" << std::endl;
+    std::cout << "  'm' to step down as master, or to run for master again" << std::endl;
+    std::cout << "  'j' to print tick jitter (or send SIGUSR1)" << std::endl;
     std::cout << std::endl;
     
     if (isMaster) {
         std::cout << "Running as MASTER process" << std::endl;
         pm.setMasterMode(true);
+        startWorkerPool(pm);
     } else {
-        std::cout << "Running as SLAVE process" << std::endl;
+        std::cout << "Running as SLAVE process (master is PID " << election.currentMaster()
+                  << ")" << std::endl;
         pm.setMasterMode(false);
     }
     
@@ -234,65 +571,186 @@ int main(int argc, char* argv[]) {
         workerThread = std::thread(runSlave);
     }
     
+    // Restarts the worker thread in the other role
+    auto switchRole = [&](bool master) {
+        stopWorker();
+        if (workerThread.joinable()) {
+            workerThread.join();
+        }
+        
+        isMaster = master;
+        pm.setMasterMode(master);
+        if (!master) {
+            pm.stopWorkerPool();
+        }
+        if (!running.load()) {
+            return;
+        }
+        if (master) {
+            startWorkerPool(pm);
+        }
+        workerRunning.store(true);
+        workerThread = std::thread(master ? runMaster : runSlave);
+    };
+    
+    // Renews or takes over the lease; runs every pollInterval()
+    auto checkElection = [&]() {
+        bool elected = election.poll();
+        if (elected == isMaster) {
+            return;
+        }
+        
+        switchRole(elected);
+        if (elected) {
+            logger.logWithTime("Elected master");
+            std::cout << "Elected MASTER" << std::endl;
+        } else {
+            logger.logf(LOG_FMT("Lost the master lease to PID {}"), election.currentMaster());
+            std::cout << "Lost the master lease, running as SLAVE" << std::endl;
+        }
+    };
+    
     // Main thread handles user input
     std::string input;
     
-    while (running.load()) {
-        if (kbhit()) {
-            char c = getchar();
-            
-            if (c == 'q' || c == 'Q') {
-                running.store(false);
-                break;
-            } else if (c == 'm' || c == 'M') {
-                // Toggle master mode (for testing)
-                isMaster = !isMaster;
-                pm.setMasterMode(isMaster);
-                
-                // Restart worker thread with new mode
-                running.store(false);
-                if (workerThread.joinable()) {
-                    workerThread.join();
-                }
-                
-                running.store(true);
-                if (isMaster) {
-                    workerThread = std::thread(runMaster);
-                    std::cout << "Switched to MASTER mode" << std::endl;
-                } else {
-                    workerThread = std::thread(runSlave);
-                    std::cout << "Switched to SLAVE mode" << std::endl;
-                }
-            } else if (c == '\n') {
-                if (!input.empty()) {
-                    try {
-                        int newValue = std::stoi(input);
-                        counter.setValue(newValue);
-                        logger.logWithTime("User set counter to " + input);
-                        std::cout << "Counter set to: " << newValue << std::endl;
-                    } catch (const std::exception& e) {
-                        std::cout << "Invalid number: " << input << std::endl;
-                    }
-                    input.clear();
+    auto handleKey = [&](char c) {
+        if (c == 'q' || c == 'Q') {
+            shutdown();
+        } else if (c == 'j' || c == 'J') {
+            dumpTickJitter();
+        } else if (c == 'm' || c == 'M') {
+            // Through the election, so there is never more than one master
+            if (isMaster) {
+                election.resign();
+                switchRole(false);
+                logger.logWithTime("Stepped down as master");
+                std::cout << "Switched to SLAVE mode; another instance can take over" << std::endl;
+            } else if (election.campaign()) {
+                switchRole(true);
+                logger.logWithTime("Elected master");
+                std::cout << "Switched to MASTER mode" << std::endl;
+            } else {
+                std::cout << "PID " << election.currentMaster()
+                          << " is master; press 'm' there to hand over" << std::endl;
+            }
+        } else if (c == '\n') {
+            if (!input.empty()) {
+                try {
+                    int newValue = std::stoi(input);
+                    int oldValue = counter.exchange(newValue);
+                    logger.logf(LOG_FMT("User set counter to {} (was {})"), input, oldValue);
+                    std::cout << "Counter set to: " << newValue << std::endl;
+                } catch (const std::exception& e) {
+                    std::cout << "Invalid number: " << input << std::endl;
                 }
-            } else if (isdigit(c) || c == '-') {
-                input += c;
-                std::cout << c;
-                fflush(stdout);
+                input.clear();
             }
+        } else if (isdigit(c) || c == '-') {
+            input += c;
+            std::cout << c;
+            fflush(stdout);
+        }
+    };
+    
+#ifdef _WIN32
+    auto nextElectionCheck = std::chrono::steady_clock::now();
+    while (running.load()) {
+        if (kbhit()) {
+            handleKey(static_cast<char>(getchar()));
+        }
+        
+        if (jitterDumpRequested.exchange(false)) {
+            dumpTickJitter();
+        }
+        
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextElectionCheck) {
+            checkElection();
+            nextElectionCheck = now + election.pollInterval();
         }
         
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
+#else
+    // Sleep in the event loop until stdin is readable or a signal needs
+    // attention; the terminal mode is set once rather than per key
+    enterRawMode();
+    
+    Scheduler inputLoop;
+    inputLoop.setWakeHandler([]() {
+        if (jitterDumpRequested.exchange(false)) {
+            dumpTickJitter();
+        }
+    });
+    
+    // Returns false once stdin is exhausted
+    auto readInput = [&]() -> bool {
+        char buffer[256];
+        ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            return true;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        
+        for (ssize_t i = 0; i < n && running.load(); i++) {
+            handleKey(buffer[i]);
+        }
+        return true;
+    };
+    
+    inputLoop.addPeriodic(election.pollInterval(), checkElection);
+    
+    inputScheduler.store(&inputLoop);
+    if (!inputLoop.watchFd(STDIN_FILENO, [&]() {
+            if (!readInput()) {
+                // EOF: keep running until a signal or the worker stops us
+                inputLoop.unwatchFd(STDIN_FILENO);
+            }
+        })) {
+        // Regular files cannot be polled and are always readable
+        while (running.load() && readInput()) {
+        }
+    }
+    
+    inputLoop.run(running);
+    inputScheduler.store(nullptr);
+#endif
     
     // Cleanup
     if (workerThread.joinable()) {
         workerThread.join();
     }
     
+    // Hand over now rather than after the lease expires
+    election.resign();
+    if (counterCheckpoint && !counterCheckpoint->write(counter.getValue())) {
+        std::cerr << "Final counter checkpoint failed" << std::endl;
+    }
+    
+    dumpTickJitter();
     logger.logWithTime("Process terminating");
-    logger.close();
+    if (logOptions.async || logOptions.shared) {
+        LogStats stats = logger.getStats();
+        uint64_t avgNs = stats.enqueued ? stats.enqueueNsTotal / stats.enqueued : 0;
+        logger.log("Logger stats: enqueued " + std::to_string(stats.enqueued) +
+                   ", dropped " + std::to_string(stats.dropped) +
+                   ", batches " + std::to_string(stats.batches) +
+                   ", avg enqueue " + std::to_string(avgNs) + " ns" +
+                   ", max enqueue " + std::to_string(stats.enqueueNsMax) + " ns");
+    }
+    JobStats jobs = pm.getJobStats();
+    logger.log("Child jobs: launched " + std::to_string(jobs.launched) +
+               ", completed " + std::to_string(jobs.completed) +
+               ", failed " + std::to_string(jobs.failed));
     pm.cleanup();
+    logger.flush();
+    logger.close();
+    
+#ifndef _WIN32
+    restoreTerminal();
+#endif
     
     std::cout << "\nProgram terminated." << std::endl;
     
@@ -0,0 +1,502 @@
+#include "mapped_log_file.h"
+#include "shared_segment.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const uint32_t kControlMagic = 0x4c4f4746; // "LOGF"
+const int kOffsetBits = 40;
+const uint64_t kOffsetMask = (1ULL << kOffsetBits) - 1;
+
+// How long a writer waits for somebody else's rotation before dropping
+const int kRotationWaitMs = 2000;
+
+uint64_t generationOf(uint64_t position) {
+    return position >> kOffsetBits;
+}
+
+uint64_t offsetOf(uint64_t position) {
+    return position & kOffsetMask;
+}
+
+int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+MappedLogFile::MappedLogFile()
+    : control(nullptr), fd(-1), base(nullptr), mappedGeneration(0), rotationCount(0) {}
+
+MappedLogFile::~MappedLogFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedLogFile::open(const std::string&, const MappedLogOptions&) {
+    return false;
+}
+
+void MappedLogFile::close() {}
+
+bool MappedLogFile::append(const char*, size_t) {
+    return false;
+}
+
+bool MappedLogFile::append(const LogRecordView*, size_t) {
+    return false;
+}
+
+#else
+
+bool MappedLogFile::open(const std::string& path, const MappedLogOptions& options) {
+    this->options = options;
+    if (this->options.segmentBytes < (1 << 20)) {
+        this->options.segmentBytes = 1 << 20;
+    }
+    
+    char resolved[4096];
+    std::string absolute = path;
+    if (path[0] != '/' && getcwd(resolved, sizeof(resolved))) {
+        absolute = std::string(resolved) + "/" + path;
+    }
+    this->path = absolute;
+    
+    // One control block per log file, shared by every process writing it
+    char name[64];
+    snprintf(name, sizeof(name), "/labwork_logfile_%zx", std::hash<std::string>()(absolute));
+    controlName = name;
+    
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool creator = true;
+        int cfd = shm_open(controlName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (cfd == -1 && errno == EEXIST) {
+            creator = false;
+            cfd = shm_open(controlName.c_str(), O_RDWR, 0666);
+        }
+        if (cfd == -1) {
+            perror("shm_open");
+            return false;
+        }
+        if (creator && ftruncate(cfd, sizeof(Control)) == -1) {
+            perror("ftruncate");
+            ::close(cfd);
+            return false;
+        }
+        
+        void* mem = mmap(NULL, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED, cfd, 0);
+        ::close(cfd);
+        if (mem == MAP_FAILED) {
+            perror("mmap");
+            return false;
+        }
+        control = static_cast<Control*>(mem);
+        
+        AttachResult result = attach(creator);
+        if (result == AttachResult::Attached) {
+            return true;
+        }
+        munmap(control, sizeof(Control));
+        control = nullptr;
+        if (creator || result == AttachResult::Failed) {
+            return false;
+        }
+        
+        // Left behind by processes that are gone and whose file was removed
+        shm_unlink(controlName.c_str());
+    }
+    
+    return false;
+}
+
+MappedLogFile::AttachResult MappedLogFile::attach(bool creator) {
+    if (creator) {
+        // Start from a fresh segment; an existing file from an earlier run
+        // becomes path.1
+        int newFd;
+        uint64_t inode;
+        if (!createSegment(newFd, inode)) {
+            shm_unlink(controlName.c_str());
+            return AttachResult::Failed;
+        }
+        ::close(newFd);
+        installSegment();
+        
+        control->segmentBytes = options.segmentBytes;
+        control->inode.store(inode);
+        control->segmentStart.store(nowSeconds());
+        control->attachLock.store(0);
+        for (auto& user : control->users) {
+            user.store(0);
+        }
+        control->rotationClaim.store(0);
+        control->position.store(0);
+        __atomic_store_n(&control->magic, kControlMagic, __ATOMIC_RELEASE);
+    } else {
+        for (int i = 0; i < 1000 && __atomic_load_n(&control->magic, __ATOMIC_ACQUIRE) != kControlMagic; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (__atomic_load_n(&control->magic, __ATOMIC_ACQUIRE) != kControlMagic) {
+            return AttachResult::Stale;
+        }
+        // Segment size is fixed by whoever created the control block
+        options.segmentBytes = control->segmentBytes;
+    }
+    
+    // Unregistered, this process would not count as a user, and another
+    // could trim the file under it on the way out
+    lockAttach();
+    if (!registerUser(true)) {
+        unlockAttach();
+        fprintf(stderr, "Mapped log %s already has %zu writers\n", path.c_str(),
+                sizeof(control->users) / sizeof(control->users[0]));
+        return AttachResult::Failed;
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(mapMutex);
+    bool ok = remapLocked(true);
+    if (!ok) {
+        registerUser(false);
+    }
+    unlockAttach();
+    return ok ? AttachResult::Attached : AttachResult::Stale;
+}
+
+void MappedLogFile::close() {
+    if (!control) {
+        return;
+    }
+    
+    lockAttach();
+    std::unique_lock<std::shared_mutex> lock(mapMutex);
+    registerUser(false);
+    
+    // The last process out trims the preallocated tail so the file ends
+    // at the last record. Users that died without detaching do not count.
+    bool last = true;
+    for (auto& user : control->users) {
+        int userPid = user.load();
+        if (userPid != 0 && processExists(userPid)) {
+            last = false;
+            break;
+        }
+    }
+    if (last) {
+        uint64_t position = control->position.load();
+        if (fd != -1 && generationOf(position) == mappedGeneration &&
+            offsetOf(position) <= options.segmentBytes) {
+            if (ftruncate(fd, offsetOf(position)) == -1) {
+                perror("ftruncate");
+            }
+        }
+    }
+    unlockAttach();
+    
+    unmapSegment();
+    munmap(control, sizeof(Control));
+    control = nullptr;
+}
+
+void MappedLogFile::lockAttach() {
+    int self = getpid();
+    for (;;) {
+        int holder = control->attachLock.load();
+        if ((holder == 0 || !processExists(holder)) &&
+            control->attachLock.compare_exchange_weak(holder, self)) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void MappedLogFile::unlockAttach() {
+    control->attachLock.store(0);
+}
+
+bool MappedLogFile::registerUser(bool add) {
+    int self = getpid();
+    for (auto& user : control->users) {
+        int userPid = user.load();
+        if (add && (userPid == 0 || !processExists(userPid))) {
+            if (user.compare_exchange_strong(userPid, self)) {
+                return true;
+            }
+        } else if (!add && userPid == self) {
+            user.store(0);
+            return true;
+        }
+    }
+    return false;
+}
+
+void MappedLogFile::unmapSegment() {
+    if (base) {
+        munmap(base, options.segmentBytes);
+        base = nullptr;
+    }
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool MappedLogFile::createSegment(int& newFd, uint64_t& inode) {
+    std::string next = path + ".new";
+    newFd = ::open(next.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (newFd == -1) {
+        perror("open");
+        return false;
+    }
+    
+    int rc;
+#ifdef __linux__
+    rc = fallocate(newFd, 0, 0, options.segmentBytes);
+    if (rc == -1 && errno == EOPNOTSUPP) {
+        rc = ftruncate(newFd, options.segmentBytes);
+    }
+#else
+    rc = ftruncate(newFd, options.segmentBytes);
+#endif
+    if (rc == -1) {
+        perror("fallocate");
+        ::close(newFd);
+        unlink(next.c_str());
+        return false;
+    }
+    
+    struct stat st;
+    fstat(newFd, &st);
+    inode = static_cast<uint64_t>(st.st_ino);
+    return true;
+}
+
+void MappedLogFile::installSegment() {
+    shiftOldSegments();
+    if (rename((path + ".new").c_str(), path.c_str()) == -1) {
+        perror("rename");
+    }
+}
+
+void MappedLogFile::shiftOldSegments() {
+    for (int i = options.keepFiles - 1; i >= 1; i--) {
+        std::string from = path + "." + std::to_string(i);
+        std::string to = path + "." + std::to_string(i + 1);
+        rename(from.c_str(), to.c_str());
+    }
+    if (options.keepFiles > 0) {
+        rename(path.c_str(), (path + ".1").c_str());
+    } else {
+        unlink(path.c_str());
+    }
+}
+
+bool MappedLogFile::remapLocked(bool attaching) {
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        // Read a consistent (generation, inode) pair
+        uint64_t before = control->position.load();
+        uint64_t inode = control->inode.load();
+        uint64_t after = control->position.load();
+        if (generationOf(before) != generationOf(after)) {
+            continue;
+        }
+        
+        int newFd = ::open(path.c_str(), O_RDWR);
+        struct stat st;
+        if (newFd == -1 || fstat(newFd, &st) == -1 ||
+            static_cast<uint64_t>(st.st_ino) != inode ||
+            static_cast<uint64_t>(st.st_size) < options.segmentBytes) {
+            // Either mid-rotation (retry until the new segment is published)
+            // or, when attaching, trimmed by the last process to detach
+            if (attaching && newFd != -1 && static_cast<uint64_t>(st.st_ino) == inode &&
+                control->rotationClaim.load() == generationOf(before) &&
+                ftruncate(newFd, options.segmentBytes) == 0) {
+                ::close(newFd);
+                continue;
+            }
+            if (newFd != -1) {
+                ::close(newFd);
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        
+        void* mem = mmap(NULL, options.segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, newFd, 0);
+        if (mem == MAP_FAILED) {
+            perror("mmap");
+            ::close(newFd);
+            return false;
+        }
+        
+        unmapSegment();
+        fd = newFd;
+        base = static_cast<char*>(mem);
+        mappedGeneration = generationOf(before);
+        return true;
+    }
+    
+    return false;
+}
+
+bool MappedLogFile::remap(uint64_t staleGeneration) {
+    std::unique_lock<std::shared_mutex> lock(mapMutex);
+    if (mappedGeneration != staleGeneration && base) {
+        return true; // another thread already did it
+    }
+    return remapLocked();
+}
+
+void MappedLogFile::rotate(uint64_t generation, uint64_t usedBytes) {
+    uint64_t claim = generation;
+    if (!control->rotationClaim.compare_exchange_strong(claim, generation + 1)) {
+        return; // somebody else is rotating this generation
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(mapMutex);
+    if (mappedGeneration != generation && !remapLocked()) {
+        return;
+    }
+    
+    // The old segment is left whole until its successor exists, so on
+    // failure writers can go on appending to it
+    int newFd;
+    uint64_t inode;
+    if (!createSegment(newFd, inode)) {
+        control->rotationClaim.store(generation);
+        control->position.store(generation << kOffsetBits | usedBytes);
+        return;
+    }
+    ::close(newFd);
+    
+    // Writers still copying into this segment only touch bytes below
+    // usedBytes, so trimming the tail is safe
+    if (mappedGeneration == generation && ftruncate(fd, usedBytes) == -1) {
+        perror("ftruncate");
+    }
+    installSegment();
+    
+    control->inode.store(inode);
+    control->segmentStart.store(nowSeconds());
+    control->position.store((generation + 1) << kOffsetBits);
+    rotationCount.fetch_add(1);
+    
+    remapLocked();
+}
+
+bool MappedLogFile::waitForGeneration(uint64_t generation) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kRotationWaitMs);
+    while (generationOf(control->position.load()) == generation) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            // The writer that should rotate died or failed; keep the whole
+            // segment, since the exact end is unknown
+            rotate(generation, options.segmentBytes);
+            return generationOf(control->position.load()) != generation;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+bool MappedLogFile::append(const char* data, size_t length) {
+    LogRecordView view = {data, length};
+    return append(&view, 1);
+}
+
+bool MappedLogFile::append(const LogRecordView* views, size_t count) {
+    if (!control || count == 0) {
+        return false;
+    }
+    
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += views[i].length;
+    }
+    if (total > options.segmentBytes / 2) {
+        // Never let one batch fill a whole segment
+        bool ok = append(views, count / 2);
+        return append(views + count / 2, count - count / 2) && ok;
+    }
+    
+    for (int attempt = 0; attempt < 64; attempt++) {
+        bool done = false;
+        if (!tryAppend(views, count, total, done)) {
+            return false;
+        }
+        if (done) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MappedLogFile::tryAppend(const LogRecordView* views, size_t count, size_t total, bool& done) {
+    std::shared_lock<std::shared_mutex> lock(mapMutex);
+    uint64_t current = control->position.load(std::memory_order_relaxed);
+    uint64_t generation = generationOf(current);
+    
+    if (generation != mappedGeneration) {
+        uint64_t stale = mappedGeneration;
+        lock.unlock();
+        return remap(stale);
+    }
+    if (offsetOf(current) > options.segmentBytes) {
+        lock.unlock();
+        return waitForGeneration(generation);
+    }
+    
+    // Age-based rotation: seal the segment and rotate it
+    if (options.maxAgeSec > 0 && offsetOf(current) > 0 &&
+        nowSeconds() - control->segmentStart.load() >= options.maxAgeSec) {
+        uint64_t sealed = generation << kOffsetBits | (options.segmentBytes + 1);
+        if (control->position.compare_exchange_strong(current, sealed)) {
+            lock.unlock();
+            rotate(generation, offsetOf(current));
+        }
+        return true;
+    }
+    
+    // Reserve only within the mapped generation. A fetch_add could land in
+    // a segment rotated meanwhile and, if that one is gone too, leave a
+    // zero-filled gap behind; here a rotation just means starting over.
+    uint64_t reserved = current;
+    while (!control->position.compare_exchange_weak(reserved, reserved + total)) {
+        if (generationOf(reserved) != generation || offsetOf(reserved) > options.segmentBytes) {
+            return true;
+        }
+    }
+    uint64_t offset = offsetOf(reserved);
+    
+    if (offset + total <= options.segmentBytes) {
+        char* dest = base + offset;
+        for (size_t i = 0; i < count; i++) {
+            memcpy(dest, views[i].data, views[i].length);
+            dest += views[i].length;
+        }
+        done = true;
+        return true;
+    }
+    
+    lock.unlock();
+    if (offset <= options.segmentBytes) {
+        // This reservation crossed the end: rotate, then retry
+        rotate(generation, offset);
+        return true;
+    }
+    return waitForGeneration(generation);
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include "master_election.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+uint32_t holderPid(uint64_t holder) {
+    return static_cast<uint32_t>(holder >> 32);
+}
+
+uint32_t holderTerm(uint64_t holder) {
+    return static_cast<uint32_t>(holder);
+}
+
+uint64_t makeHolder(uint32_t pid, uint32_t term) {
+    return (static_cast<uint64_t>(pid) << 32) | term;
+}
+
+} // namespace
+
+MasterElection& MasterElection::getInstance() {
+    static MasterElection instance;
+    return instance;
+}
+
+MasterElection::MasterElection()
+    : lease(&localFallback), heldLease(0), master(false), campaigning(true),
+      failoverTimeout(1000) {
+    localFallback.holder.store(0);
+    localFallback.heartbeatMs.store(0);
+#ifdef _WIN32
+    selfPid = static_cast<uint32_t>(GetCurrentProcessId());
+#else
+    selfPid = static_cast<uint32_t>(getpid());
+#endif
+    
+    // Never removed: the lease must outlive any one instance, and a stale
+    // holder is recognized as dead. Without the segment every instance
+    // elects itself, as before.
+    if (segment.open("/labwork_master", sizeof(MasterLease), false)) {
+        lease = static_cast<MasterLease*>(segment.data());
+    }
+}
+
+MasterElection::~MasterElection() {
+    resign();
+}
+
+void MasterElection::setFailoverTimeout(std::chrono::milliseconds timeout) {
+    failoverTimeout = timeout < std::chrono::milliseconds(40) ? std::chrono::milliseconds(40)
+                                                               : timeout;
+}
+
+// A quarter of the bound: a heartbeat that missed three polls has expired,
+// and the fourth poll of a slave takes over
+std::chrono::milliseconds MasterElection::pollInterval() const {
+    return failoverTimeout / 4;
+}
+
+int64_t MasterElection::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool MasterElection::poll() {
+    int64_t now = nowMs();
+    uint64_t holder = lease->holder.load();
+    
+    if (master) {
+        if (holder == heldLease) {
+            lease->heartbeatMs.store(now);
+            return true;
+        }
+        // Somebody took over while we were stalled
+        master = false;
+    }
+    if (!campaigning) {
+        return false;
+    }
+    
+    // Expired once its holder is gone or has stopped renewing. A holder
+    // word with our own pid is left over from a lease we already gave up.
+    uint32_t pid = holderPid(holder);
+    int64_t expireMs = failoverTimeout.count() - pollInterval().count();
+    bool expired = pid == 0 || pid == selfPid || !processExists(pid) ||
+                   now - lease->heartbeatMs.load() > expireMs;
+    if (!expired) {
+        return false;
+    }
+    
+    // Refresh the heartbeat first so that nobody sees the new term stale
+    uint64_t ours = makeHolder(selfPid, holderTerm(holder) + 1);
+    lease->heartbeatMs.store(now);
+    if (!lease->holder.compare_exchange_strong(holder, ours)) {
+        return false;
+    }
+    
+    heldLease = ours;
+    master = true;
+    return true;
+}
+
+void MasterElection::resign() {
+    campaigning = false;
+    if (!master) {
+        return;
+    }
+    
+    // Keep the term so the next holder still gets a higher one
+    uint64_t expected = heldLease;
+    lease->holder.compare_exchange_strong(expected, makeHolder(0, holderTerm(heldLease)));
+    master = false;
+}
+
+bool MasterElection::campaign() {
+    campaigning = true;
+    return poll();
+}
+
+long MasterElection::currentMaster() const {
+    uint32_t pid = holderPid(lease->holder.load());
+    return pid != 0 && processExists(pid) ? static_cast<long>(pid) : 0;
+}
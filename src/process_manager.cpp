@@ -1,6 +1,10 @@
 #include "process_manager.h"
 #include "logger.h"
 #include "counter.h"
+#include "worker_pool.h"
+#include "scheduler.h"
+#include "child_job.h"
+#include "process_stats.h"
 #include <iostream>
 #include <thread>
 #include <chrono>
@@ -10,15 +14,82 @@
 #include <tchar.h>
 #else
 #include <sys/wait.h>
+#include <spawn.h>
+#include <signal.h>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/resource.h>
+
+extern char** environ;
+#endif
+
+#ifdef __linux__
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+int openPidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
 #endif
+}
+#endif
+
+// Publishes how a per-job child process ended
+void recordChildExit(const ChildProcess& child, bool ok) {
+    ProcessStatsSlot& stats = ProcessStats::getInstance().slot();
+    stats.childrenReaped.fetch_add(1, std::memory_order_relaxed);
+    if (!ok) {
+        stats.childrenFailed.fetch_add(1, std::memory_order_relaxed);
+    }
+    stats.childLifetimeNs.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - child.started).count());
+}
+
+} // namespace
 
 ProcessManager& ProcessManager::getInstance() {
     static ProcessManager instance;
     return instance;
 }
 
-ProcessManager::ProcessManager() : isMasterProcess(false) {}
+ProcessManager::ProcessManager()
+    : isMasterProcess(false),
+      launchMethod(LaunchMethod::Spawn),
+      exePath(getExecutablePath()),
+      jobStats{0, 0, 0},
+      childMode(ChildMode::Process),
+      loopRunning(false),
+      threadJobsActive(0),
+      threadJobsCompleted(0),
+      signalFd(-1),
+      maxQueuedJobs(16),
+      rejectedJobs(0),
+      completedAtSnapshot(0),
+      snapshotTime(std::chrono::steady_clock::now()) {
+    for (int i = 0; i < kMaxChildTypes; i++) {
+        maxConcurrency[i] = 1;
+        runningJobs[i] = 0;
+    }
+    
+#ifdef __linux__
+    // For the signalfd fallback SIGCHLD must be blocked in every thread, so
+    // getInstance() has to run before other threads start. Children get a
+    // clean mask from startProcess().
+    sigset_t childSignal;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &childSignal, nullptr);
+#endif
+}
 
 ProcessManager::~ProcessManager() {
     cleanup();
@@ -26,8 +97,120 @@ ProcessManager::~ProcessManager() {
 
 bool ProcessManager::launchChildProcess(int type) {
     std::lock_guard<std::mutex> lock(childrenMutex);
+    return launchLocked(type);
+}
+
+bool ProcessManager::submitJob(int type) {
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    
+    if (pool) {
+        // The pool keeps its own queue; a full one is a rejection too
+        if (!launchLocked(type)) {
+            rejectedJobs++;
+            return false;
+        }
+        return true;
+    }
+    if (type < 0 || type >= kMaxChildTypes || pendingJobs.size() >= maxQueuedJobs) {
+        rejectedJobs++;
+        return false;
+    }
+    
+    pendingJobs.push_back(PendingJob{type, std::chrono::steady_clock::now()});
+    dispatchLocked();
+    return true;
+}
+
+// Starts every queued job whose type has a free slot, oldest first. A type
+// at its limit does not hold up jobs of other types behind it.
+void ProcessManager::dispatchLocked() {
+    auto it = pendingJobs.begin();
+    while (it != pendingJobs.end()) {
+        int type = it->type;
+        if (runningJobs[type] >= maxConcurrency[type]) {
+            ++it;
+            continue;
+        }
+        
+        auto now = std::chrono::steady_clock::now();
+        queueWait.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - it->queuedAt).count()));
+        it = pendingJobs.erase(it);
+        if (!launchLocked(type)) {
+            // submitJob() already accepted it, so it fails rather than
+            // counting as a queue-full rejection
+            jobStats.completed++;
+            jobStats.failed++;
+            Logger::getInstance().logf(LOG_FMT("Failed to launch queued child job {}"), type);
+        }
+    }
+}
+
+void ProcessManager::jobFinishedLocked(int type) {
+    if (type >= 0 && type < kMaxChildTypes && runningJobs[type] > 0) {
+        runningJobs[type]--;
+    }
+}
+
+void ProcessManager::setMaxConcurrency(int type, int limit) {
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    if (type >= 0 && type < kMaxChildTypes) {
+        maxConcurrency[type] = limit > 0 ? limit : 1;
+        dispatchLocked();
+    }
+}
+
+void ProcessManager::setMaxQueuedJobs(size_t limit) {
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    maxQueuedJobs = limit;
+}
+
+JobQueueStats ProcessManager::getJobQueueStats() {
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    
+    JobQueueStats stats;
+    stats.queued = pendingJobs.size();
+    stats.running = 0;
+    for (int count : runningJobs) {
+        stats.running += static_cast<size_t>(count);
+    }
+    stats.rejected = rejectedJobs;
+    
+    auto now = std::chrono::steady_clock::now();
+    uint64_t completed = completedJobsLocked();
+    double seconds = std::chrono::duration<double>(now - snapshotTime).count();
+    stats.completedPerSecond = seconds > 0 ? (completed - completedAtSnapshot) / seconds : 0.0;
+    completedAtSnapshot = completed;
+    snapshotTime = now;
+    
+    stats.waitP50Us = queueWait.percentile(0.5) / 1000;
+    stats.waitP99Us = queueWait.percentile(0.99) / 1000;
+    stats.waitMaxUs = queueWait.max() / 1000;
+    return stats;
+}
+
+bool ProcessManager::launchLocked(int type) {
+    if (childMode.load() == ChildMode::Thread) {
+        startEventLoop();
+        threadJobsActive.fetch_add(1);
+        jobStats.launched++;
+        if (type >= 0 && type < kMaxChildTypes) {
+            runningJobs[type]++;
+        }
+        eventLoop->post([this, type]() {
+            runThreadJobStep(type, 0);
+        });
+        return true;
+    }
+    
+    if (pool) {
+        if (!pool->submit(type)) {
+            return false;
+        }
+        jobStats.launched++;
+        return true;
+    }
     
-    std::string exePath = getExecutablePath();
     if (exePath.empty()) {
         return false;
     }
@@ -41,6 +224,9 @@ bool ProcessManager::launchChildProcess(int type) {
     ZeroMemory(&pi, sizeof(pi));
     
     std::string cmd = exePath + " --child " + std::to_string(type);
+    for (const auto& arg : childArgs) {
+        cmd += " " + arg;
+    }
     
     if (!CreateProcess(
         NULL,
@@ -63,118 +249,291 @@ bool ProcessManager::launchChildProcess(int type) {
     child.pid = pi.dwProcessId;
     child.type = type;
     child.startTime = time(nullptr);
-    child.finished = false;
+    child.started = std::chrono::steady_clock::now();
     
-    children.push_back(child);
+    children.insert(child);
     
     CloseHandle(pi.hThread);
+    jobStats.launched++;
+    ProcessStats::getInstance().slot().childrenLaunched.fetch_add(1, std::memory_order_relaxed);
+    if (type >= 0 && type < kMaxChildTypes) {
+        runningJobs[type]++;
+    }
     
 #else
-    pid_t pid = fork();
+    std::vector<std::string> args = {exePath, "--child", std::to_string(type)};
+    args.insert(args.end(), childArgs.begin(), childArgs.end());
     
-    if (pid == 0) { // Child process
-        std::string typeStr = std::to_string(type);
-        
-        // Prepare arguments for exec
-        char* args[] = {
-            const_cast<char*>(exePath.c_str()),
-            const_cast<char*>("--child"),
-            const_cast<char*>(typeStr.c_str()),
-            NULL
-        };
-        
-        execv(exePath.c_str(), args);
-        
-        // If exec fails
-        perror("execv");
-        exit(1);
-    } else if (pid > 0) { // Parent process
-        ChildProcess child;
-        child.pid = pid;
-        child.type = type;
-        child.startTime = time(nullptr);
-        child.finished = false;
-        
-        children.push_back(child);
-    } else {
-        perror("fork");
+    pid_t pid = startProcess(exePath, args, launchMethod.load());
+    if (pid == -1) {
         return false;
     }
+    
+    ChildProcess child;
+    child.pid = pid;
+    child.type = type;
+    child.startTime = time(nullptr);
+    child.started = std::chrono::steady_clock::now();
+    child.pidfd = -1;
+    
+#ifdef __linux__
+    // Reap from the event loop the moment the child exits
+    startEventLoop();
+    child.pidfd = openPidfd(pid);
+    if (child.pidfd >= 0) {
+        int pidfd = child.pidfd;
+        eventLoop->post([this, pid, pidfd]() {
+            eventLoop->watchFd(pidfd, [this, pid]() {
+                reapChild(pid);
+            });
+        });
+    } else if (signalFd == -1) {
+        watchChildSignals();
+    }
+#endif
+    
+    children.insert(child);
+    jobStats.launched++;
+    ProcessStats::getInstance().slot().childrenLaunched.fetch_add(1, std::memory_order_relaxed);
+    if (type >= 0 && type < kMaxChildTypes) {
+        runningJobs[type]++;
+    }
 #endif
     
     return true;
 }
 
+void ProcessManager::startEventLoop() {
+    if (eventLoop) {
+        return;
+    }
+    eventLoop.reset(new Scheduler());
+    loopRunning.store(true);
+    loopThread = std::thread([this]() {
+        eventLoop->run(loopRunning);
+    });
+}
+
+// Must be called without childrenMutex: loop callbacks take it
+void ProcessManager::stopEventLoop() {
+    std::unique_ptr<Scheduler> loop;
+    {
+        std::lock_guard<std::mutex> lock(childrenMutex);
+        if (!eventLoop) {
+            return;
+        }
+        loopRunning.store(false);
+        eventLoop->stop();
+    }
+    loopThread.join();
+    
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    eventLoop.reset();
+#ifdef __linux__
+    if (signalFd != -1) {
+        close(signalFd);
+        signalFd = -1;
+    }
+#endif
+}
+
+#ifndef _WIN32
+// Records how a child ended and forgets it. Called with childrenMutex held.
+void ProcessManager::finishChild(size_t slot, int status, const struct rusage& usage) {
+    ChildProcess* it = &children.at(slot);
+    double wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - it->started).count();
+    double cpuMs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+                   (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+    
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    recordChildExit(*it, ok);
+    jobFinishedLocked(it->type);
+    jobStats.completed++;
+    if (!ok) {
+        jobStats.failed++;
+    }
+    
+    char line[160];
+    if (WIFSIGNALED(status)) {
+        snprintf(line, sizeof(line), "Child %d (PID %d) killed by signal %d, wall %.1f ms, cpu %.1f ms",
+                 it->type, static_cast<int>(it->pid), WTERMSIG(status), wallMs, cpuMs);
+    } else {
+        snprintf(line, sizeof(line), "Child %d (PID %d) exited with status %d, wall %.1f ms, cpu %.1f ms",
+                 it->type, static_cast<int>(it->pid), WEXITSTATUS(status), wallMs, cpuMs);
+    }
+    Logger::getInstance().logf(LOG_FMT("{}"), line);
+    
+#ifdef __linux__
+    if (it->pidfd >= 0) {
+        if (eventLoop) {
+            eventLoop->unwatchFd(it->pidfd);
+        }
+        close(it->pidfd);
+    }
+#endif
+    children.remove(slot);
+}
+#endif
+
+#ifdef __linux__
+// Event loop callback for a readable pidfd
+void ProcessManager::reapChild(pid_t pid) {
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    
+    size_t slot = children.find(pid);
+    int status;
+    struct rusage usage;
+    if (slot != ChildTable::kNoSlot && wait4(pid, &status, WNOHANG, &usage) == pid) {
+        finishChild(slot, status, usage);
+        dispatchLocked();
+    }
+}
+
+// Fallback for kernels without pidfd_open: one signalfd for SIGCHLD. Signals
+// coalesce, so every readable event sweeps all children.
+void ProcessManager::watchChildSignals() {
+    sigset_t childSignal;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    signalFd = signalfd(-1, &childSignal, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signalFd == -1) {
+        perror("signalfd");
+        return;
+    }
+    
+    int fd = signalFd;
+    eventLoop->post([this, fd]() {
+        eventLoop->watchFd(fd, [this, fd]() {
+            struct signalfd_siginfo info;
+            while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+            }
+            
+            std::lock_guard<std::mutex> lock(childrenMutex);
+            children.forEach([this](size_t slot, ChildProcess& child) {
+                int status;
+                struct rusage usage;
+                if (child.pidfd == -1 && wait4(child.pid, &status, WNOHANG, &usage) == child.pid) {
+                    finishChild(slot, status, usage);
+                }
+            });
+            dispatchLocked();
+        });
+    });
+}
+#endif
+
+// Runs on the event loop thread; schedules the next step instead of sleeping
+void ProcessManager::runThreadJobStep(int type, int step) {
+    std::chrono::milliseconds wait = runChildJobStep(type, step);
+    if (wait.count() < 0) {
+        std::lock_guard<std::mutex> lock(childrenMutex);
+        threadJobsCompleted.fetch_add(1);
+        threadJobsActive.fetch_sub(1);
+        jobFinishedLocked(type);
+        dispatchLocked();
+        return;
+    }
+    
+    eventLoop->post([this, type, step]() {
+        runThreadJobStep(type, step + 1);
+    }, wait);
+}
+
 void ProcessManager::checkFinishedProcesses() {
     std::lock_guard<std::mutex> lock(childrenMutex);
     
-    auto it = children.begin();
-    while (it != children.end()) {
-        if (it->finished) {
-            it = children.erase(it);
-            continue;
+    if (pool) {
+        int died = pool->superviseWorkers();
+        if (died > 0) {
+            Logger::getInstance().logf(LOG_FMT("Restarted {} crashed pool worker(s)"), died);
         }
-        
+    }
+    
+    children.forEach([this](size_t slot, ChildProcess& child) {
 #ifdef _WIN32
         DWORD exitCode;
-        if (GetExitCodeProcess(it->handle, &exitCode)) {
-            if (exitCode != STILL_ACTIVE) {
-                it->finished = true;
-                CloseHandle(it->handle);
-                it = children.erase(it);
-                continue;
+        if (GetExitCodeProcess(child.handle, &exitCode) && exitCode != STILL_ACTIVE) {
+            recordChildExit(child, exitCode == 0);
+            jobStats.completed++;
+            if (exitCode != 0) {
+                jobStats.failed++;
             }
+            jobFinishedLocked(child.type);
+            CloseHandle(child.handle);
+            children.remove(slot);
         }
 #else
+        // Children behind a pidfd or the SIGCHLD signalfd are reaped by the
+        // event loop as soon as they exit
+        if (child.pidfd >= 0 || signalFd != -1) {
+            return;
+        }
+        
         int status;
-        pid_t result = waitpid(it->pid, &status, WNOHANG);
+        struct rusage usage;
+        pid_t result = wait4(child.pid, &status, WNOHANG, &usage);
         if (result > 0) {
-            it->finished = true;
-            it = children.erase(it);
-            continue;
+            finishChild(slot, status, usage);
         } else if (result == -1) {
             // Error
-            it->finished = true;
-            it = children.erase(it);
-            continue;
+            recordChildExit(child, false);
+            jobStats.completed++;
+            jobStats.failed++;
+            jobFinishedLocked(child.type);
+            children.remove(slot);
         }
 #endif
-        
-        ++it;
-    }
+    });
+    
+    dispatchLocked();
 }
 
+// Lock-free, so polling it never holds up the reaper. The pool only changes
+// in startWorkerPool(), stopWorkerPool() and cleanup(), none of which
+// overlaps launching.
 bool ProcessManager::hasActiveChildren() {
-    std::lock_guard<std::mutex> lock(childrenMutex);
-    
-    for (const auto& child : children) {
-        if (!child.finished) {
-            return true;
-        }
+    if (children.active() > 0 || threadJobsActive.load() > 0) {
+        return true;
     }
-    
-    return false;
+    return pool && pool->completed() < pool->submitted();
 }
 
 void ProcessManager::cleanup() {
+    stopEventLoop();
+    
     std::lock_guard<std::mutex> lock(childrenMutex);
     
+    // Unfinished in-process jobs are dropped, like killed children
+    int dropped = threadJobsActive.exchange(0);
+    jobStats.completed += static_cast<uint64_t>(dropped);
+    jobStats.failed += static_cast<uint64_t>(dropped);
+    
+    stopPoolLocked();
+    
 #ifdef _WIN32
-    for (auto& child : children) {
-        if (!child.finished) {
-            TerminateProcess(child.handle, 0);
-            CloseHandle(child.handle);
-        }
-    }
+    children.forEach([](size_t, ChildProcess& child) {
+        TerminateProcess(child.handle, 0);
+        CloseHandle(child.handle);
+    });
 #else
-    for (auto& child : children) {
-        if (!child.finished) {
-            kill(child.pid, SIGTERM);
+    children.forEach([](size_t, ChildProcess& child) {
+        kill(child.pid, SIGTERM);
+    });
+    // Reap them so nothing still counts them as running
+    children.forEach([](size_t, ChildProcess& child) {
+        waitpid(child.pid, nullptr, 0);
+        if (child.pidfd >= 0) {
+            close(child.pidfd);
         }
-    }
+    });
 #endif
     
     children.clear();
+    pendingJobs.clear();
+    for (int& count : runningJobs) {
+        count = 0;
+    }
 }
 
 void ProcessManager::setMasterMode(bool isMaster) {
@@ -185,6 +544,132 @@ bool ProcessManager::isMaster() const {
     return isMasterProcess.load();
 }
 
+void ProcessManager::setChildArguments(const std::vector<std::string>& args) {
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    childArgs = args;
+}
+
+void ProcessManager::setLaunchMethod(LaunchMethod method) {
+    launchMethod.store(method);
+}
+
+LaunchMethod ProcessManager::getLaunchMethod() const {
+    return launchMethod.load();
+}
+
+void ProcessManager::setChildMode(ChildMode mode) {
+    childMode.store(mode);
+}
+
+ChildMode ProcessManager::getChildMode() const {
+    return childMode.load();
+}
+
+bool ProcessManager::startWorkerPool(int workers) {
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    
+    if (pool || exePath.empty()) {
+        return false;
+    }
+    
+    // Workers get the same options as children, then "--worker <segment> <slot>"
+    std::vector<std::string> command = {exePath};
+    command.insert(command.end(), childArgs.begin(), childArgs.end());
+    command.push_back("--worker");
+    
+    std::unique_ptr<WorkerPool> newPool(new WorkerPool());
+    if (!newPool->start(workers, command, launchMethod.load())) {
+        return false;
+    }
+    pool = std::move(newPool);
+    return true;
+}
+
+void ProcessManager::stopWorkerPool() {
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    stopPoolLocked();
+}
+
+// Keeps the pool's job counts once it is gone
+void ProcessManager::stopPoolLocked() {
+    if (!pool) {
+        return;
+    }
+    pool->stop();
+    jobStats.completed += pool->completed();
+    jobStats.failed += pool->failed();
+    pool.reset();
+}
+
+uint64_t ProcessManager::completedJobsLocked() {
+    uint64_t completed = jobStats.completed + threadJobsCompleted.load();
+    if (pool) {
+        completed += pool->completed();
+    }
+    return completed;
+}
+
+JobStats ProcessManager::getJobStats() {
+    std::lock_guard<std::mutex> lock(childrenMutex);
+    
+    JobStats stats = jobStats;
+    stats.completed += threadJobsCompleted.load();
+    if (pool) {
+        stats.completed += pool->completed();
+        stats.failed += pool->failed();
+    }
+    return stats;
+}
+
+#ifndef _WIN32
+pid_t ProcessManager::startProcess(const std::string& path, const std::vector<std::string>& args,
+                                   LaunchMethod method) {
+    // Build argv up front: only async-signal-safe calls may run between
+    // fork() and exec in a multi-threaded parent
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(NULL);
+    
+    // Children start with no blocked signals, whatever thread launched them
+    sigset_t noSignals;
+    sigemptyset(&noSignals);
+    
+    if (method == LaunchMethod::Spawn) {
+        // glibc implements this with clone(CLONE_VM | CLONE_VFORK), so no page
+        // tables are copied however large the parent is
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setsigmask(&attr, &noSignals);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+        
+        pid_t pid;
+        int rc = posix_spawn(&pid, path.c_str(), NULL, &attr, argv.data(), environ);
+        posix_spawnattr_destroy(&attr);
+        if (rc != 0) {
+            std::cerr << "posix_spawn failed: " << strerror(rc) << std::endl;
+            return -1;
+        }
+        return pid;
+    }
+    
+    pid_t pid = fork();
+    if (pid == 0) { // Child process
+        sigprocmask(SIG_SETMASK, &noSignals, NULL);
+        execv(path.c_str(), argv.data());
+        
+        // If exec fails
+        perror("execv");
+        _exit(1);
+    } else if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    return pid;
+}
+#endif
+
 std::string ProcessManager::getExecutablePath() {
 #ifdef _WIN32
     char path[MAX_PATH];
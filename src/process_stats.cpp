@@ -0,0 +1,389 @@
+#include "process_stats.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char* kStatsSegmentName = "/labwork_stats";
+
+// A process killed mid-retirement leaves the in-progress count raised for
+// good; readers then settle for what they read on the last attempt
+const int kMaxReadAttempts = 100;
+
+const char* roleName(uint32_t role) {
+    switch (static_cast<StatsRole>(role)) {
+    case StatsRole::Master:
+        return "master";
+    case StatsRole::Slave:
+        return "slave";
+    case StatsRole::Child:
+        return "child";
+    case StatsRole::Worker:
+        return "worker";
+    default:
+        return "other";
+    }
+}
+
+uint32_t currentPid() {
+#ifdef _WIN32
+    return static_cast<uint32_t>(GetCurrentProcessId());
+#else
+    return static_cast<uint32_t>(getpid());
+#endif
+}
+
+void addCounters(ProcessStatsSlot& to, const ProcessStatsSlot& from) {
+    to.ticksMissed.fetch_add(from.ticksMissed.load(), std::memory_order_relaxed);
+    to.logRecords.fetch_add(from.logRecords.load(), std::memory_order_relaxed);
+    to.logBytes.fetch_add(from.logBytes.load(), std::memory_order_relaxed);
+    to.childrenLaunched.fetch_add(from.childrenLaunched.load(), std::memory_order_relaxed);
+    to.childrenReaped.fetch_add(from.childrenReaped.load(), std::memory_order_relaxed);
+    to.childrenFailed.fetch_add(from.childrenFailed.load(), std::memory_order_relaxed);
+    to.tickLatenessNs.merge(from.tickLatenessNs);
+    to.logWriteNs.merge(from.logWriteNs);
+    to.childLifetimeNs.merge(from.childLifetimeNs);
+}
+
+void resetSlot(ProcessStatsSlot& slot) {
+    slot.role.store(static_cast<uint32_t>(StatsRole::Other));
+    slot.ticksMissed.store(0);
+    slot.logRecords.store(0);
+    slot.logBytes.store(0);
+    slot.childrenLaunched.store(0);
+    slot.childrenReaped.store(0);
+    slot.childrenFailed.store(0);
+    slot.tickLatenessNs.reset();
+    slot.logWriteNs.reset();
+    slot.childLifetimeNs.reset();
+}
+
+// Moves a slot's numbers into the retired totals in slot 0
+void retireSlot(StatsSegmentHeader* header, ProcessStatsSlot& slot) {
+    header->retiring.fetch_add(1);
+    addCounters(header->slots[0], slot);
+    resetSlot(slot);
+    header->retirements.fetch_add(1);
+    header->retiring.fetch_sub(1);
+}
+
+// Runs read() again until no retirement started or finished while it ran,
+// so it sees each retiring slot's numbers exactly once
+template <typename Read>
+void readConsistently(const StatsSegmentHeader* header, Read read) {
+    for (int attempt = 1;; attempt++) {
+        bool quiet = header->retiring.load() == 0;
+        uint64_t retirements = header->retirements.load();
+        read();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((quiet && header->retiring.load() == 0 &&
+             header->retirements.load() == retirements) || attempt == kMaxReadAttempts) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Exited processes plus every slot still held; see summarize
+void addSlots(const StatsSegmentHeader* header, StatsSummary& total) {
+    total.add(header->slots[0]);
+    for (int i = 1; i <= kMaxStatsSlots; i++) {
+        uint32_t pid = header->slots[i].pid.load();
+        if (pid == 0) {
+            continue;
+        }
+        if (processExists(pid)) {
+            total.processes++;
+        }
+        total.add(header->slots[i]);
+    }
+}
+
+} // namespace
+
+ProcessStats& ProcessStats::getInstance() {
+    static ProcessStats instance;
+    return instance;
+}
+
+ProcessStats::ProcessStats() : header(nullptr), current(&localSlot) {
+    resetSlot(localSlot);
+    localSlot.pid.store(0);
+    
+    if (!segment.open(kStatsSegmentName, sizeof(StatsSegmentHeader), false)) {
+        return;
+    }
+    StatsSegmentHeader* mapped = static_cast<StatsSegmentHeader*>(segment.data());
+    
+    // Fresh pages are zero, which is an empty slot
+    if (segment.created()) {
+        mapped->version = kStatsVersion;
+        mapped->slotCount = kMaxStatsSlots;
+        mapped->magic.store(kStatsMagic, std::memory_order_release);
+    } else if (!SharedSegment::waitForMagic(mapped->magic, kStatsMagic) ||
+               mapped->version != kStatsVersion || mapped->slotCount != kMaxStatsSlots) {
+        std::cerr << "Stats segment " << kStatsSegmentName
+                  << " is from another version; remove it once no labwork process is running"
+                  << std::endl;
+        segment.close();
+        return;
+    }
+    header = mapped;
+    
+    // A free slot first, then one whose owner died without handing it back
+    uint32_t self = currentPid();
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 1; i <= kMaxStatsSlots; i++) {
+            ProcessStatsSlot& candidate = header->slots[i];
+            uint32_t owner = candidate.pid.load();
+            if (pass == 0 ? owner != 0 : owner == 0 || (owner != self && processExists(owner))) {
+                continue;
+            }
+            if (!candidate.pid.compare_exchange_strong(owner, self)) {
+                continue;
+            }
+            
+            if (owner != 0) {
+                retireSlot(header, candidate);
+            }
+            current.store(&candidate);
+            return;
+        }
+    }
+}
+
+ProcessStats::~ProcessStats() {
+    release();
+}
+
+void ProcessStats::setRole(StatsRole role) {
+    slot().role.store(static_cast<uint32_t>(role), std::memory_order_relaxed);
+}
+
+void ProcessStats::release() {
+    ProcessStatsSlot* mine = current.load();
+    if (mine == &localSlot) {
+        return;
+    }
+    
+    // Anything published from here on goes nowhere
+    current.store(&localSlot);
+    retireSlot(header, *mine);
+    mine->pid.store(0);
+}
+
+StatsSummary::StatsSummary()
+    : processes(0), ticksMissed(0), logRecords(0), logBytes(0), childrenLaunched(0),
+      childrenReaped(0), childrenFailed(0) {
+}
+
+void StatsSummary::clear() {
+    processes = 0;
+    ticksMissed = 0;
+    logRecords = 0;
+    logBytes = 0;
+    childrenLaunched = 0;
+    childrenReaped = 0;
+    childrenFailed = 0;
+    tickLatenessNs.reset();
+    logWriteNs.reset();
+    childLifetimeNs.reset();
+}
+
+void StatsSummary::add(const ProcessStatsSlot& slot) {
+    ticksMissed += slot.ticksMissed.load(std::memory_order_relaxed);
+    logRecords += slot.logRecords.load(std::memory_order_relaxed);
+    logBytes += slot.logBytes.load(std::memory_order_relaxed);
+    childrenLaunched += slot.childrenLaunched.load(std::memory_order_relaxed);
+    childrenReaped += slot.childrenReaped.load(std::memory_order_relaxed);
+    childrenFailed += slot.childrenFailed.load(std::memory_order_relaxed);
+    tickLatenessNs.merge(slot.tickLatenessNs);
+    logWriteNs.merge(slot.logWriteNs);
+    childLifetimeNs.merge(slot.childLifetimeNs);
+}
+
+bool StatsReader::open() {
+    if (!segment.open(kStatsSegmentName, sizeof(StatsSegmentHeader), true)) {
+        std::cerr << "No stats yet: start labwork first" << std::endl;
+        return false;
+    }
+    
+    const StatsSegmentHeader* mapped = static_cast<const StatsSegmentHeader*>(segment.data());
+    if (!SharedSegment::waitForMagic(mapped->magic, kStatsMagic) ||
+        mapped->version != kStatsVersion || mapped->slotCount != kMaxStatsSlots) {
+        std::cerr << "Stats segment " << kStatsSegmentName << " is from another version"
+                  << std::endl;
+        segment.close();
+        return false;
+    }
+    header = mapped;
+    return true;
+}
+
+void StatsReader::summarize(StatsSummary& total) const {
+    readConsistently(header, [this, &total]() {
+        total.clear();
+        addSlots(header, total);
+    });
+}
+
+void StatsReader::printTable(FILE* out) const {
+    fprintf(out, "%-8s %-7s %-6s %9s %7s %10s %12s %9s %9s %9s %7s %10s\n", "pid", "role",
+            "state", "ticks", "missed", "log recs", "log bytes", "write p99", "launched",
+            "reaped", "failed", "life p50");
+    
+    // Rows and totals come from one consistent read, so a process retiring
+    // meanwhile shows in its own row or in "gone", not both
+    std::vector<std::string> rows;
+    StatsSummary total;
+    auto addRow = [&rows](const char* pid, const char* role, const char* state,
+                          const ProcessStatsSlot& s) {
+        char row[256];
+        snprintf(row, sizeof(row),
+                 "%-8s %-7s %-6s %9llu %7llu %10llu %12llu %7.1fus %9llu %9llu %7llu %8.1fms\n",
+                 pid, role, state,
+                 static_cast<unsigned long long>(s.tickLatenessNs.count()),
+                 static_cast<unsigned long long>(s.ticksMissed.load()),
+                 static_cast<unsigned long long>(s.logRecords.load()),
+                 static_cast<unsigned long long>(s.logBytes.load()),
+                 s.logWriteNs.percentile(0.99) / 1000.0,
+                 static_cast<unsigned long long>(s.childrenLaunched.load()),
+                 static_cast<unsigned long long>(s.childrenReaped.load()),
+                 static_cast<unsigned long long>(s.childrenFailed.load()),
+                 s.childLifetimeNs.percentile(0.5) / 1e6);
+        rows.push_back(row);
+    };
+    
+    readConsistently(header, [this, &rows, &total, &addRow]() {
+        rows.clear();
+        for (int i = 1; i <= kMaxStatsSlots; i++) {
+            const ProcessStatsSlot& s = header->slots[i];
+            uint32_t pid = s.pid.load();
+            if (pid == 0) {
+                continue;
+            }
+            char pidText[16];
+            snprintf(pidText, sizeof(pidText), "%u", pid);
+            addRow(pidText, roleName(s.role.load()), processExists(pid) ? "alive" : "exited", s);
+        }
+        addRow("-", "-", "gone", header->slots[0]);
+        
+        total.clear();
+        addSlots(header, total);
+    });
+    
+    for (const std::string& row : rows) {
+        fputs(row.c_str(), out);
+    }
+    fprintf(out, "total: %llu processes, %llu ticks (%llu missed), tick lateness p99 %.1f us, "
+                 "%llu log records, %llu bytes, log write p99 %.1f us, "
+                 "children %llu launched, %llu reaped, %llu failed, lifetime p99 %.1f ms\n",
+            static_cast<unsigned long long>(total.processes),
+            static_cast<unsigned long long>(total.tickLatenessNs.count()),
+            static_cast<unsigned long long>(total.ticksMissed),
+            total.tickLatenessNs.percentile(0.99) / 1000.0,
+            static_cast<unsigned long long>(total.logRecords),
+            static_cast<unsigned long long>(total.logBytes),
+            total.logWriteNs.percentile(0.99) / 1000.0,
+            static_cast<unsigned long long>(total.childrenLaunched),
+            static_cast<unsigned long long>(total.childrenReaped),
+            static_cast<unsigned long long>(total.childrenFailed),
+            total.childLifetimeNs.percentile(0.99) / 1e6);
+}
+
+namespace {
+
+void writeCounter(FILE* f, const char* name, const char* help, uint64_t value) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name,
+            static_cast<unsigned long long>(value));
+}
+
+// Buckets at powers of two from 1 us to 16 s. Every LatencyHistogram
+// bucket ends just below a power of two, so the cumulative counts are exact.
+void writeHistogram(FILE* f, const char* name, const char* help, const LatencyHistogram& h) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    
+    uint64_t cumulative = 0;
+    int bucket = 0;
+    for (int shift = 10; shift <= 34; shift++) {
+        uint64_t bound = 1ull << shift;
+        for (; bucket < LatencyHistogram::kBuckets &&
+               LatencyHistogram::bucketUpperBound(bucket) < bound; bucket++) {
+            cumulative += h.bucketCount(bucket);
+        }
+        fprintf(f, "%s_bucket{le=\"%.9g\"} %llu\n", name, bound / 1e9,
+                static_cast<unsigned long long>(cumulative));
+    }
+    for (; bucket < LatencyHistogram::kBuckets; bucket++) {
+        cumulative += h.bucketCount(bucket);
+    }
+    fprintf(f, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9g\n%s_count %llu\n", name,
+            static_cast<unsigned long long>(cumulative), name, h.sum() / 1e9, name,
+            static_cast<unsigned long long>(cumulative));
+}
+
+} // namespace
+
+bool StatsReader::writePrometheus(const std::string& path) const {
+    std::string temporary = path + ".tmp";
+    FILE* f = fopen(temporary.c_str(), "w");
+    if (!f) {
+        perror(temporary.c_str());
+        return false;
+    }
+    
+    StatsSummary total;
+    summarize(total);
+    
+    uint64_t byRole[5] = {0, 0, 0, 0, 0};
+    for (int i = 1; i <= kMaxStatsSlots; i++) {
+        const ProcessStatsSlot& s = header->slots[i];
+        uint32_t role = s.role.load();
+        uint32_t pid = s.pid.load();
+        if (pid != 0 && role < 5 && processExists(pid)) {
+            byRole[role]++;
+        }
+    }
+    fprintf(f, "# HELP labwork_processes Processes publishing stats\n"
+               "# TYPE labwork_processes gauge\n");
+    for (uint32_t role = 0; role < 5; role++) {
+        fprintf(f, "labwork_processes{role=\"%s\"} %llu\n", roleName(role),
+                static_cast<unsigned long long>(byRole[role]));
+    }
+    
+    writeCounter(f, "labwork_ticks_total", "Counter ticks fired", total.tickLatenessNs.count());
+    writeCounter(f, "labwork_ticks_missed_total",
+                 "Ticks skipped or caught up after a whole period was lost", total.ticksMissed);
+    writeHistogram(f, "labwork_tick_lateness_seconds", "How late each tick fired",
+                   total.tickLatenessNs);
+    writeCounter(f, "labwork_log_records_total", "Log records written", total.logRecords);
+    writeCounter(f, "labwork_log_bytes_total", "Log bytes written", total.logBytes);
+    writeHistogram(f, "labwork_log_write_seconds", "Time to write a log record or batch",
+                   total.logWriteNs);
+    writeCounter(f, "labwork_children_launched_total", "Child processes launched",
+                 total.childrenLaunched);
+    writeCounter(f, "labwork_children_reaped_total", "Child processes reaped",
+                 total.childrenReaped);
+    writeCounter(f, "labwork_children_failed_total",
+                 "Child processes that exited non-zero or were killed", total.childrenFailed);
+    writeHistogram(f, "labwork_child_lifetime_seconds", "Child process launch to reap",
+                   total.childLifetimeNs);
+    
+    bool ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        perror(path.c_str());
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
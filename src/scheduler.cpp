@@ -0,0 +1,305 @@
+#include "scheduler.h"
+#include "latency_histogram.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+Scheduler::Scheduler()
+    : stopped(false),
+      wakeRequested(false),
+      wakeupCount(0),
+      missedCount(0),
+      shortestInterval(Clock::duration::max()) {
+#if defined(__linux__)
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || timerFd == -1 || wakeFd == -1) {
+        perror("scheduler setup");
+    }
+    
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = timerFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev);
+    ev.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+#elif !defined(_WIN32)
+    if (pipe(wakePipe) == -1) {
+        perror("pipe");
+        wakePipe[0] = wakePipe[1] = -1;
+    } else {
+        for (int fd : wakePipe) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+#endif
+}
+
+Scheduler::~Scheduler() {
+#if defined(__linux__)
+    close(wakeFd);
+    close(timerFd);
+    close(epollFd);
+#elif !defined(_WIN32)
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+#endif
+}
+
+void Scheduler::addPeriodic(Clock::duration interval, Task task,
+                            MissedTicks policy, LatencyHistogram* lateness) {
+    if (interval <= Clock::duration::zero()) {
+        interval = std::chrono::nanoseconds(1);
+    }
+    if (interval < shortestInterval) {
+        shortestInterval = interval;
+    }
+    
+    tasks.push_back(std::move(task));
+    heap.push_back(Entry{Clock::now() + interval, interval, tasks.size() - 1, policy, lateness, 0});
+    std::push_heap(heap.begin(), heap.end(), later);
+}
+
+void Scheduler::post(Task task, Clock::duration delay) {
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        posted.emplace_back(Clock::now() + delay, std::move(task));
+    }
+    signalWake();
+}
+
+// Moves tasks handed in by post() into the heap
+void Scheduler::takePosted() {
+    std::vector<std::pair<Clock::time_point, Task>> batch;
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        batch.swap(posted);
+    }
+    
+    for (auto& item : batch) {
+        size_t index;
+        if (!freeTasks.empty()) {
+            index = freeTasks.back();
+            freeTasks.pop_back();
+            tasks[index] = std::move(item.second);
+        } else {
+            tasks.push_back(std::move(item.second));
+            index = tasks.size() - 1;
+        }
+        heap.push_back(Entry{item.first, Clock::duration::zero(), index, MissedTicks::Skip, nullptr, 0});
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
+}
+
+bool Scheduler::watchFd(int fd, Task onReadable) {
+#if defined(__linux__)
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        return false; // EPERM for regular files
+    }
+#elif defined(_WIN32)
+    (void)fd;
+    (void)onReadable;
+    return false;
+#endif
+    watches.push_back(Watch{fd, std::move(onReadable)});
+    return true;
+}
+
+void Scheduler::unwatchFd(int fd) {
+#if defined(__linux__)
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+    for (size_t i = 0; i < watches.size(); i++) {
+        if (watches[i].fd == fd) {
+            watches.erase(watches.begin() + i);
+            break;
+        }
+    }
+}
+
+void Scheduler::setWakeHandler(Task handler) {
+    wakeHandler = std::move(handler);
+}
+
+void Scheduler::run(const std::atomic<bool>& running) {
+    stopped.store(false);
+    
+#ifdef __linux__
+    // The default 50 us timer slack would dominate sub-millisecond ticks
+    if (shortestInterval < std::chrono::milliseconds(1)) {
+        prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+    }
+#endif
+    
+    std::vector<int> readyFds;
+    while (running.load() && !stopped.load()) {
+        takePosted();
+        readyFds.clear();
+        wait(heap.empty() ? nullptr : &heap.front().deadline, readyFds);
+        wakeupCount.fetch_add(1, std::memory_order_relaxed);
+        
+        if (wakeRequested.exchange(false) && wakeHandler) {
+            wakeHandler();
+        }
+        
+        // Handlers may unwatch fds, so look each one up again
+        for (int fd : readyFds) {
+            for (size_t i = 0; i < watches.size(); i++) {
+                if (watches[i].fd == fd) {
+                    Task handler = watches[i].onReadable;
+                    handler();
+                    break;
+                }
+            }
+        }
+        
+        // Run everything that is due, earliest first
+        takePosted();
+        auto now = Clock::now();
+        while (!heap.empty() && heap.front().deadline <= now) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            Entry& entry = heap.back();
+            
+            if (entry.lateness) {
+                entry.lateness->record(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - entry.deadline).count()));
+            }
+            tasks[entry.task]();
+            
+            if (entry.interval == Clock::duration::zero()) {
+                tasks[entry.task] = nullptr;
+                freeTasks.push_back(entry.task);
+                heap.pop_back();
+                continue;
+            }
+            
+            entry.deadline += entry.interval;
+            now = Clock::now();
+            if (entry.deadline <= now) {
+                if (entry.policy == MissedTicks::CatchUp && entry.behind < kMaxCatchUp) {
+                    entry.behind++;
+                } else {
+                    // Jump to the first grid point still in the future
+                    auto missed = (now - entry.deadline) / entry.interval + 1;
+                    entry.deadline += missed * entry.interval;
+                    missedCount.fetch_add(static_cast<uint64_t>(missed), std::memory_order_relaxed);
+                    entry.behind = 0;
+                }
+            } else {
+                entry.behind = 0;
+            }
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+    }
+}
+
+void Scheduler::stop() {
+    stopped.store(true);
+    signalWake();
+}
+
+void Scheduler::wake() {
+    wakeRequested.store(true);
+    signalWake();
+}
+
+void Scheduler::signalWake() {
+#if defined(__linux__)
+    uint64_t one = 1;
+    ssize_t rc = write(wakeFd, &one, sizeof(one));
+    (void)rc;
+#elif !defined(_WIN32)
+    char one = 1;
+    ssize_t rc = write(wakePipe[1], &one, 1);
+    (void)rc;
+#else
+    waitCv.notify_all();
+#endif
+}
+
+void Scheduler::wait(const Clock::time_point* deadline, std::vector<int>& readyFds) {
+#if defined(__linux__)
+    // steady_clock is CLOCK_MONOTONIC on Linux, so the deadline can be
+    // armed as an absolute timerfd expiry. A zero expiry disarms it.
+    struct itimerspec spec = {};
+    if (deadline) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            deadline->time_since_epoch()).count();
+        if (ns <= 0) {
+            ns = 1;
+        }
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+    }
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    
+    struct epoll_event events[16];
+    int n;
+    do {
+        n = epoll_wait(epollFd, events, 16, -1);
+    } while (n == -1 && errno == EINTR && !stopped.load() && !wakeRequested.load());
+    
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        if (fd == timerFd || fd == wakeFd) {
+            uint64_t value;
+            ssize_t rc = read(fd, &value, sizeof(value));
+            (void)rc;
+        } else {
+            readyFds.push_back(fd);
+        }
+    }
+#elif !defined(_WIN32)
+    std::vector<struct pollfd> fds;
+    fds.push_back({wakePipe[0], POLLIN, 0});
+    for (const Watch& watch : watches) {
+        fds.push_back({watch.fd, POLLIN, 0});
+    }
+    
+    int timeoutMs = -1;
+    if (deadline) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            *deadline - Clock::now()).count();
+        timeoutMs = left < 0 ? 0 : static_cast<int>(left) + 1;
+    }
+    
+    int n = poll(fds.data(), fds.size(), timeoutMs);
+    if (n > 0) {
+        if (fds[0].revents) {
+            char drain[64];
+            while (read(wakePipe[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (fds[i].revents) {
+                readyFds.push_back(fds[i].fd);
+            }
+        }
+    }
+#else
+    std::unique_lock<std::mutex> lock(waitMutex);
+    auto ready = [this] { return stopped.load() || wakeRequested.load(); };
+    if (deadline) {
+        waitCv.wait_until(lock, *deadline, ready);
+    } else {
+        waitCv.wait(lock, ready);
+    }
+#endif
+}
@@ -0,0 +1,215 @@
+#include "shared_log_ring.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Set in a slot's sequence while its writer copies the record in
+const uint64_t kSlotWriting = 1ull << 63;
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+SharedLogRing::SharedLogRing()
+    : header(nullptr), slots(nullptr), mask(0), pid(0), stalledPosition(0), stalledSinceMs(0) {}
+
+SharedLogRing::~SharedLogRing() {
+    close();
+}
+
+size_t SharedLogRing::segmentSize() {
+    return sizeof(Header) + sizeof(Slot) * kSharedLogCapacity;
+}
+
+bool SharedLogRing::open(const char* name) {
+#ifdef _WIN32
+    (void)name;
+    return false;
+#else
+    pid = getpid();
+    if (!segment.open(name, segmentSize(), false)) {
+        return false;
+    }
+    
+    Header* h = static_cast<Header*>(segment.data());
+    Slot* s = reinterpret_cast<Slot*>(static_cast<char*>(segment.data()) + sizeof(Header));
+    
+    // Whoever creates the segment initializes it; everyone else waits for
+    // the magic to appear
+    if (segment.created()) {
+        h->capacity = kSharedLogCapacity;
+        h->drainerPid.store(0);
+        h->skipped.store(0);
+        h->tail.store(0);
+        h->head.store(0);
+        for (uint32_t i = 0; i < kSharedLogCapacity; i++) {
+            s[i].sequence.store(i);
+            s[i].length = 0;
+        }
+        h->magic.store(kSharedLogMagic, std::memory_order_release);
+    } else if (!SharedSegment::waitForMagic(h->magic, kSharedLogMagic) ||
+               h->capacity != kSharedLogCapacity) {
+        fprintf(stderr, "Shared log segment %s has an unexpected layout\n", name);
+        segment.close();
+        return false;
+    }
+    
+    header = h;
+    slots = s;
+    mask = kSharedLogCapacity - 1;
+    return true;
+#endif
+}
+
+void SharedLogRing::close() {
+    if (!header) {
+        return;
+    }
+    releaseDrainer();
+    segment.close();
+    header = nullptr;
+    slots = nullptr;
+}
+
+bool SharedLogRing::tryPush(const char* data, size_t length) {
+    uint64_t pos = header->tail.load(std::memory_order_relaxed);
+    Slot* slot;
+    
+    for (;;) {
+        slot = &slots[pos & mask];
+        uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq - pos);
+        
+        if (seq & kSlotWriting) {
+            // Claimed by another writer, so the tail has moved on
+            pos = header->tail.load(std::memory_order_relaxed);
+        } else if (diff == 0) {
+            if (header->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = header->tail.load(std::memory_order_relaxed);
+        }
+    }
+    
+    // Take the slot from the drainer's stall check before touching it.
+    // Failing means it was skipped while we stalled and may already hold
+    // another writer's record.
+    uint64_t expected = pos;
+    if (!slot->sequence.compare_exchange_strong(expected, pos | kSlotWriting,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+        return false;
+    }
+    
+    if (length > sizeof(slot->data)) {
+        length = sizeof(slot->data);
+        memcpy(slot->data, data, length - 1);
+        slot->data[length - 1] = '\n';
+    } else {
+        memcpy(slot->data, data, length);
+    }
+    slot->length = static_cast<uint32_t>(length);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+size_t SharedLogRing::peek(LogRecordView* out, size_t max, int stallMs) {
+    uint64_t pos = header->head.load(std::memory_order_relaxed);
+    uint64_t tail = header->tail.load(std::memory_order_acquire);
+    size_t count = 0;
+    
+    while (count < max && pos + count < tail) {
+        Slot& slot = slots[(pos + count) & mask];
+        uint64_t seq = slot.sequence.load(std::memory_order_acquire);
+        if (seq == pos + count + 1) {
+            out[count].data = slot.data;
+            out[count].length = slot.length;
+            count++;
+            continue;
+        }
+        
+        // Claimed but not started on. Only the oldest slot can be skipped,
+        // and only after it has been stuck for stallMs.
+        if (count == 0 && seq == pos) {
+            int64_t now = nowMs();
+            if (stalledPosition != pos || stalledSinceMs == 0) {
+                stalledPosition = pos;
+                stalledSinceMs = now;
+            } else if (now - stalledSinceMs >= stallMs) {
+                // Losing the race means the writer started after all
+                uint64_t expected = pos;
+                stalledSinceMs = 0;
+                if (slot.sequence.compare_exchange_strong(expected, pos + mask + 1,
+                                                          std::memory_order_acq_rel)) {
+                    out[0].data = "";
+                    out[0].length = 0;
+                    header->skipped.fetch_add(1);
+                    count = 1;
+                }
+                continue;
+            }
+        }
+        break;
+    }
+    
+    return count;
+}
+
+void SharedLogRing::release(size_t count) {
+    uint64_t pos = header->head.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; i++) {
+        slots[(pos + i) & mask].sequence.store(pos + i + mask + 1, std::memory_order_release);
+    }
+    header->head.store(pos + count, std::memory_order_release);
+}
+
+uint64_t SharedLogRing::skippedRecords() const {
+    return header ? header->skipped.load() : 0;
+}
+
+bool SharedLogRing::tryAcquireDrainer() {
+    if (!header) {
+        return false;
+    }
+    
+    int holder = header->drainerPid.load();
+    if (holder == pid) {
+        return true;
+    }
+    if (holder != 0 && processExists(holder)) {
+        return false;
+    }
+    return header->drainerPid.compare_exchange_strong(holder, pid);
+}
+
+bool SharedLogRing::isDrainer() const {
+    return header && header->drainerPid.load() == pid;
+}
+
+void SharedLogRing::releaseDrainer() {
+    if (!header) {
+        return;
+    }
+    int expected = pid;
+    header->drainerPid.compare_exchange_strong(expected, 0);
+}
+
+uint64_t SharedLogRing::headPosition() const {
+    return header ? header->head.load(std::memory_order_acquire) : 0;
+}
+
+uint64_t SharedLogRing::tailPosition() const {
+    return header ? header->tail.load(std::memory_order_acquire) : 0;
+}
@@ -0,0 +1,160 @@
+#include "shared_segment.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+// How long to wait for another process that is creating a segment
+const int kCreateWaitMs = 1000;
+
+} // namespace
+
+SharedSegment::SharedSegment() : memory(nullptr), mappedSize(0), createdSegment(false) {
+#ifdef _WIN32
+    mapHandle = NULL;
+#endif
+}
+
+SharedSegment::~SharedSegment() {
+    close();
+}
+
+bool SharedSegment::open(const char* name, size_t size, bool readOnly) {
+    if (memory) {
+        return false;
+    }
+    createdSegment = false;
+    
+#ifdef _WIN32
+    // "/labwork_stats" becomes "Global\labwork_stats"
+    std::string mappingName = std::string("Global\\") + (name[0] == '/' ? name + 1 : name);
+    if (readOnly) {
+        mapHandle = OpenFileMappingA(FILE_MAP_READ, FALSE, mappingName.c_str());
+    } else {
+        mapHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                                       static_cast<DWORD>(size), mappingName.c_str());
+        createdSegment = mapHandle != NULL && GetLastError() != ERROR_ALREADY_EXISTS;
+    }
+    if (mapHandle == NULL) {
+        std::cerr << "Failed to open " << mappingName << ": " << GetLastError() << std::endl;
+        return false;
+    }
+    
+    memory = MapViewOfFile(mapHandle, readOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (memory == NULL) {
+        std::cerr << "Failed to map " << mappingName << ": " << GetLastError() << std::endl;
+        CloseHandle(mapHandle);
+        mapHandle = NULL;
+        return false;
+    }
+#else
+    int fd = -1;
+    if (!readOnly) {
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+        createdSegment = fd != -1;
+        if (fd == -1 && errno != EEXIST) {
+            perror("shm_open");
+            return false;
+        }
+    }
+    if (fd == -1) {
+        fd = shm_open(name, readOnly ? O_RDONLY : O_RDWR, 0);
+        if (fd == -1) {
+            perror("shm_open");
+            return false;
+        }
+    }
+    
+    if (createdSegment && ftruncate(fd, size) == -1) {
+        perror("ftruncate");
+        ::close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    
+    // The creator may not have sized the segment yet. Mapping past its end
+    // would fault on first access.
+    struct stat st;
+    for (int waited = 0;; waited++) {
+        if (fstat(fd, &st) == -1) {
+            perror("fstat");
+            ::close(fd);
+            return false;
+        }
+        if (static_cast<size_t>(st.st_size) >= size) {
+            break;
+        }
+        if (waited == kCreateWaitMs) {
+            std::cerr << "Shared segment " << name << " has " << st.st_size
+                      << " bytes, expected " << size << std::endl;
+            ::close(fd);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    void* mem = mmap(NULL, size, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    memory = mem;
+#endif
+    
+    mappedSize = size;
+    return true;
+}
+
+void SharedSegment::close() {
+    if (!memory) {
+        return;
+    }
+    
+#ifdef _WIN32
+    UnmapViewOfFile(memory);
+    CloseHandle(mapHandle);
+    mapHandle = NULL;
+#else
+    munmap(memory, mappedSize);
+#endif
+    memory = nullptr;
+}
+
+bool SharedSegment::waitForMagic(const std::atomic<uint32_t>& magic, uint32_t expected) {
+    for (int waited = 0; magic.load(std::memory_order_acquire) != expected; waited++) {
+        if (waited == kCreateWaitMs) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+bool processExists(uint32_t pid) {
+#ifdef _WIN32
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    if (process == NULL) {
+        return GetLastError() != ERROR_INVALID_PARAMETER;
+    }
+    bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#else
+    // EPERM: it exists, it just belongs to someone else
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+#endif
+}
@@ -0,0 +1,377 @@
+#include "worker_pool.h"
+#include "futex.h"
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#endif
+
+namespace {
+
+// How often an idle worker checks that its master still exists
+const int kIdleCheckMs = 200;
+
+// A queue slot's sequence while a worker pops it: this bit, the queue
+// position and the worker's index, so the master can tell which worker
+// holds the job and other workers can tell it from one of the last lap
+const uint64_t kSlotTaken = 1ull << 63;
+const int kTakenWorkerBits = 6;
+static_assert(kMaxPoolWorkers <= 1 << kTakenWorkerBits, "worker index must fit the mark");
+
+uint64_t takenMark(uint64_t pos, int worker) {
+    return kSlotTaken | ((pos << kTakenWorkerBits) & ~kSlotTaken) | static_cast<uint64_t>(worker);
+}
+
+} // namespace
+
+WorkerPool::WorkerPool()
+    : header(nullptr),
+      slots(nullptr),
+      launchMethod(LaunchMethod::Spawn),
+      workerCount(0),
+      submittedJobs(0) {}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+size_t WorkerPool::segmentSize() {
+    return sizeof(Header) + sizeof(Slot) * kJobQueueCapacity;
+}
+
+bool WorkerPool::start(int workers, const std::vector<std::string>& workerCommand,
+                       LaunchMethod method) {
+#ifdef _WIN32
+    (void)workers;
+    (void)workerCommand;
+    (void)method;
+    return false;
+#else
+    if (header || workers <= 0 || workers > kMaxPoolWorkers || workerCommand.empty()) {
+        return false;
+    }
+    
+    name = "/labwork_pool_" + std::to_string(getpid());
+    shm_unlink(name.c_str()); // left over from a crashed process with our pid
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        perror("shm_open");
+        return false;
+    }
+    if (ftruncate(fd, segmentSize()) == -1) {
+        perror("ftruncate");
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    
+    void* mem = mmap(NULL, segmentSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(name.c_str());
+        return false;
+    }
+    
+    // Fresh pages are zero, so only non-zero fields need setting
+    header = static_cast<Header*>(mem);
+    slots = reinterpret_cast<Slot*>(static_cast<char*>(mem) + sizeof(Header));
+    header->capacity = kJobQueueCapacity;
+    header->masterPid = getpid();
+    for (uint32_t i = 0; i < kJobQueueCapacity; i++) {
+        slots[i].sequence.store(i);
+    }
+    __atomic_store_n(&header->magic, kWorkerPoolMagic, __ATOMIC_RELEASE);
+    
+    command = workerCommand;
+    launchMethod = method;
+    workerCount = workers;
+    submittedJobs.store(0);
+    for (int i = 0; i < workers; i++) {
+        if (!spawnWorker(i)) {
+            stop();
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+bool WorkerPool::spawnWorker(int slot) {
+#ifdef _WIN32
+    (void)slot;
+    return false;
+#else
+    std::vector<std::string> args = command;
+    args.push_back(name);
+    args.push_back(std::to_string(slot));
+    
+    pid_t pid = ProcessManager::startProcess(command[0], args, launchMethod);
+    header->workers[slot].jobType.store(0);
+    header->workers[slot].taking.store(0);
+    header->workers[slot].pid.store(pid > 0 ? pid : 0);
+    return pid > 0;
+#endif
+}
+
+void WorkerPool::stop() {
+#ifndef _WIN32
+    if (!header) {
+        return;
+    }
+    
+    header->stopping.store(1);
+    header->jobSignal.fetch_add(1);
+    futexWake(&header->jobSignal, INT_MAX);
+    
+    // Idle workers exit on the wake-up; busy ones are killed like children,
+    // and their jobs count as failed
+    for (int i = 0; i < workerCount; i++) {
+        pid_t pid = header->workers[i].pid.load();
+        if (pid > 0 && header->workers[i].jobType.load() != 0) {
+            kill(pid, SIGTERM);
+        }
+    }
+    for (int i = 0; i < workerCount; i++) {
+        pid_t pid = header->workers[i].pid.load();
+        if (pid > 0) {
+            waitpid(pid, nullptr, 0);
+            reclaimJob(i);
+        }
+    }
+    
+    munmap(header, segmentSize());
+    shm_unlink(name.c_str());
+    header = nullptr;
+    slots = nullptr;
+    workerCount = 0;
+#endif
+}
+
+bool WorkerPool::submit(int type) {
+    if (!header) {
+        return false;
+    }
+    
+    uint64_t pos = header->tail.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = slots[pos & (kJobQueueCapacity - 1)];
+        uint64_t seq = slot.sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq - pos);
+        if (diff == 0) {
+            if (header->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.type = type;
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = header->tail.load(std::memory_order_relaxed);
+        }
+    }
+    submittedJobs.fetch_add(1);
+    
+    // A worker going idle bumps idleWorkers before rechecking the queue, so
+    // either it sees this job or we see it and wake it
+    header->jobSignal.fetch_add(1);
+    if (header->idleWorkers.load() > 0) {
+        futexWake(&header->jobSignal, 1);
+    }
+    return true;
+}
+
+// Takes the slot itself before moving the head, and publishes the job type
+// before letting go of it, so at no point is a popped job held by a worker
+// without the segment saying which
+bool WorkerPool::tryPop(Header* header, Slot* slots, int worker, int& type) {
+    WorkerSlot& self = header->workers[worker];
+    uint64_t pos = header->head.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = slots[pos & (kJobQueueCapacity - 1)];
+        uint64_t seq = slot.sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq - (pos + 1));
+        if (seq & kSlotTaken) {
+            if ((seq | (kMaxPoolWorkers - 1)) != takenMark(pos, kMaxPoolWorkers - 1)) {
+                return false; // still held from the last lap, so pos is not filled yet
+            }
+            // Popped by a worker that has not moved the head past it yet
+            header->head.compare_exchange_strong(pos, pos + 1);
+            pos = header->head.load(std::memory_order_relaxed);
+        } else if (diff == 0) {
+            self.taking.store(pos + 1);
+            if (slot.sequence.compare_exchange_strong(seq, takenMark(pos, worker),
+                                                      std::memory_order_acq_rel)) {
+                uint64_t expected = pos;
+                header->head.compare_exchange_strong(expected, pos + 1);
+                type = slot.type;
+                self.jobType.store(type);
+                slot.sequence.store(pos + kJobQueueCapacity, std::memory_order_release);
+                self.taking.store(0);
+                return true;
+            }
+            self.taking.store(0);
+            pos = header->head.load(std::memory_order_relaxed);
+        } else if (diff < 0) {
+            return false; // empty
+        } else {
+            pos = header->head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t WorkerPool::completed() const {
+    return header ? header->completedJobs.load() : 0;
+}
+
+uint64_t WorkerPool::failed() const {
+    return header ? header->failedJobs.load() : 0;
+}
+
+int WorkerPool::superviseWorkers() {
+    int died = 0;
+#ifndef _WIN32
+    if (!header || header->stopping.load()) {
+        return 0;
+    }
+    
+    for (int i = 0; i < workerCount; i++) {
+        WorkerSlot& worker = header->workers[i];
+        pid_t pid = worker.pid.load();
+        if (pid > 0 && waitpid(pid, nullptr, WNOHANG) != pid) {
+            continue;
+        }
+        
+        if (pid > 0) {
+            died++;
+            reclaimJob(i);
+        }
+        spawnWorker(i);
+    }
+#endif
+    return died;
+}
+
+// The job a dead worker held may be half done; report it, don't rerun it.
+// One it had popped but not yet published is still marked in its queue slot.
+void WorkerPool::reclaimJob(int slot) {
+    WorkerSlot& worker = header->workers[slot];
+    bool lost = worker.jobType.exchange(0) != 0;
+    
+    uint64_t taking = worker.taking.exchange(0);
+    if (taking != 0) {
+        uint64_t pos = taking - 1;
+        uint64_t owned = takenMark(pos, slot);
+        if (slots[pos & (kJobQueueCapacity - 1)].sequence.compare_exchange_strong(
+                owned, pos + kJobQueueCapacity, std::memory_order_release)) {
+            uint64_t expected = pos;
+            header->head.compare_exchange_strong(expected, pos + 1);
+            lost = true;
+        }
+    }
+    
+    if (lost) {
+        header->failedJobs.fetch_add(1);
+        header->completedJobs.fetch_add(1);
+        header->completedSignal.fetch_add(1);
+        if (header->completionWaiters.load() > 0) {
+            futexWake(&header->completedSignal, INT_MAX);
+        }
+    }
+}
+
+bool WorkerPool::waitForCompleted(uint64_t count, int timeoutMs) {
+    if (!header) {
+        return false;
+    }
+    
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        uint32_t seen = header->completedSignal.load();
+        if (header->completedJobs.load() >= count) {
+            return true;
+        }
+        
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            return false;
+        }
+        
+        header->completionWaiters.fetch_add(1);
+        if (header->completedJobs.load() < count) {
+            futexWait(&header->completedSignal, seen, static_cast<int>(left));
+        }
+        header->completionWaiters.fetch_sub(1);
+    }
+}
+
+int WorkerPool::serve(const char* segmentName, int slot, const JobHandler& handler) {
+#ifdef _WIN32
+    (void)segmentName;
+    (void)slot;
+    (void)handler;
+    return 1;
+#else
+    int fd = shm_open(segmentName, O_RDWR, 0600);
+    if (fd == -1) {
+        perror("shm_open");
+        return 1;
+    }
+    void* mem = mmap(NULL, segmentSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    
+    Header* header = static_cast<Header*>(mem);
+    Slot* slots = reinterpret_cast<Slot*>(static_cast<char*>(mem) + sizeof(Header));
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != kWorkerPoolMagic ||
+        slot < 0 || slot >= kMaxPoolWorkers) {
+        fprintf(stderr, "Worker pool segment %s has an unexpected layout\n", segmentName);
+        munmap(mem, segmentSize());
+        return 1;
+    }
+    
+    WorkerSlot& self = header->workers[slot];
+    while (!header->stopping.load()) {
+        int type;
+        if (tryPop(header, slots, slot, type)) {
+            handler(type);
+            self.jobType.store(0);
+            self.jobsDone.fetch_add(1);
+            
+            header->completedJobs.fetch_add(1);
+            header->completedSignal.fetch_add(1);
+            if (header->completionWaiters.load() > 0) {
+                futexWake(&header->completedSignal, INT_MAX);
+            }
+            continue;
+        }
+        
+        uint32_t seen = header->jobSignal.load();
+        header->idleWorkers.fetch_add(1);
+        if (header->head.load() == header->tail.load() && !header->stopping.load()) {
+            futexWait(&header->jobSignal, seen, kIdleCheckMs);
+        }
+        header->idleWorkers.fetch_sub(1);
+        
+        if (getppid() != header->masterPid) {
+            break; // orphaned
+        }
+    }
+    
+    munmap(mem, segmentSize());
+    return 0;
+#endif
+}
@@ -0,0 +1,153 @@
+// labwork-logdump: decodes binary labwork logs (--binary-log) back into the
+// text format, optionally filtered by pid and time range.
+
+#include "log_format.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace {
+
+void printUsage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <file>\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --pid N                 only records of this process\n");
+    fprintf(stderr, "  --from 'YYYY-MM-DD HH:MM:SS'  skip earlier records (local time)\n");
+    fprintf(stderr, "  --to 'YYYY-MM-DD HH:MM:SS'    skip later records (local time)\n");
+    fprintf(stderr, "  --stats                 print binary vs text size instead of records\n");
+}
+
+// Parses local time; returns microseconds since the epoch or -1
+long long parseTime(const char* text) {
+    struct tm timeinfo;
+    memset(&timeinfo, 0, sizeof(timeinfo));
+    if (sscanf(text, "%d-%d-%d %d:%d:%d", &timeinfo.tm_year, &timeinfo.tm_mon,
+               &timeinfo.tm_mday, &timeinfo.tm_hour, &timeinfo.tm_min, &timeinfo.tm_sec) != 6) {
+        return -1;
+    }
+    timeinfo.tm_year -= 1900;
+    timeinfo.tm_mon -= 1;
+    timeinfo.tm_isdst = -1;
+    time_t seconds = mktime(&timeinfo);
+    return seconds == -1 ? -1 : static_cast<long long>(seconds) * 1000000LL;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const char* path = nullptr;
+    long long pidFilter = -1;
+    long long fromUs = -1;
+    long long toUs = -1;
+    bool statsOnly = false;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pid") == 0 && i + 1 < argc) {
+            pidFilter = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            fromUs = parseTime(argv[++i]);
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            toUs = parseTime(argv[++i]);
+            if (toUs >= 0) {
+                toUs += 999999; // inclusive of the whole second
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            statsOnly = true;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (!path) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    
+    BinaryLogDecoder decoder;
+    BinaryLogRecord record;
+    std::vector<uint8_t> buffer;
+    size_t start = 0;
+    unsigned long long binaryBytes = 0;
+    unsigned long long textBytes = 0;
+    unsigned long long events = 0;
+    unsigned long long skipped = 0;
+    
+    uint8_t chunk[64 * 1024];
+    size_t got;
+    bool eof = false;
+    
+    while (!eof) {
+        got = fread(chunk, 1, sizeof(chunk), file);
+        if (got == 0) {
+            eof = true;
+        }
+        buffer.erase(buffer.begin(), buffer.begin() + start);
+        start = 0;
+        buffer.insert(buffer.end(), chunk, chunk + got);
+        
+        while (start < buffer.size()) {
+            long n = decoder.decode(buffer.data() + start, buffer.size() - start, record);
+            if (n == 0 && !eof) {
+                break; // need more data
+            }
+            if (n <= 0) {
+                // Corrupt or truncated: resynchronize on the next tag byte
+                start++;
+                skipped++;
+                continue;
+            }
+            start += n;
+            binaryBytes += n;
+            
+            if (record.type == kBinaryDefine) {
+                continue;
+            }
+            if (pidFilter >= 0 && record.pid != pidFilter) {
+                continue;
+            }
+            bool timed = decoder.hasTimeBase(record.pid);
+            if ((fromUs >= 0 || toUs >= 0) && !timed) {
+                continue;
+            }
+            if ((fromUs >= 0 && record.timestampUs < fromUs) ||
+                (toUs >= 0 && record.timestampUs > toUs)) {
+                continue;
+            }
+            
+            std::string line = formatBinaryRecord(record);
+            events++;
+            textBytes += line.size() + 1;
+            if (!statsOnly) {
+                printf("%s\n", line.c_str());
+            }
+        }
+    }
+    
+    fclose(file);
+    
+    if (statsOnly) {
+        printf("records: %llu\n", events);
+        printf("binary bytes: %llu (%.1f per record)\n", binaryBytes,
+               events ? static_cast<double>(binaryBytes) / events : 0.0);
+        printf("text bytes: %llu (%.1f per record)\n", textBytes,
+               events ? static_cast<double>(textBytes) / events : 0.0);
+        printf("ratio: %.2fx\n", binaryBytes ? static_cast<double>(textBytes) / binaryBytes : 0.0);
+    }
+    if (skipped > 0) {
+        fprintf(stderr, "Skipped %llu undecodable bytes\n", skipped);
+    }
+    
+    return 0;
+}